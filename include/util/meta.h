@@ -81,7 +81,7 @@ MAKE_TRAIT_ALIAS_TEMPLATE(  trivial             );
 MAKE_TRAIT_ALIAS_TEMPLATE(  trivially_copyable  );
 MAKE_TRAIT_ALIAS_TEMPLATE(  standard_layout     );
 MAKE_TRAIT_ALIAS_TEMPLATE(  pod                 );
-MAKE_TRAIT_ALIAS_TEMPLATE(  literal_type        );
+//MAKE_TRAIT_ALIAS_TEMPLATE(  literal_type        );  // deprecated in C++17
 
 // properties of classes ('final' can also apply to unions)
 MAKE_TRAIT_ALIAS_TEMPLATE(  empty        );
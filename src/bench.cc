@@ -0,0 +1,369 @@
+#include "defs.h"
+#include "die.h"
+#include "jtag.h"
+#include "discover.h"
+#include "icepick.h"
+#include "dap.h"
+#include "target-subarctic.h"
+#include "hw-sim.h"
+#include "wave.h"
+#ifndef JBANG_SIM
+#include "hw-subarctic.h"
+#include "hw-gpio.h"
+#include "jtag-multi.h"
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+
+//-------------- Benchmarks --------------------------------------------------//
+//
+// Fixed workloads at each layer of the JTAG stack, run against each backend.
+// For every workload the cost per operation is reported in wall time and in
+// terms of the backend's counters (TCK cycles, pin writes, syscalls), the
+// latter being deterministic.
+//
+//	bench [-j file] [backend...]
+//
+// Backends are "sim" and (unless built as bench-sim) "padconf", the latter
+// also as "padconf-uring", "padconf-sqpoll" and "padconf-devmem" to compare its
+// privileged write engines (see privileged.h), by default all of them are run.
+// The "gpio" backend needs a target wired to the gpios (see hw-gpio.h), and
+// "gpio-x2" two of them driven in parallel (see jtag-multi.h), so these only
+// run if asked for, as does "sim-recorded" (sim with its pins recorded, see
+// wave.h).  Results are printed as a table, and also written as
+// JSON to the given file with -j.
+//
+// The raw JTAG workloads run while only the icepick is in the chain, with its
+// IDCODE selected, so that the data shifted has no side-effects.  The DAP
+// workloads read the cortex-a8 debug registers, which is harmless too.
+
+struct BenchResult {
+	char const *backend;
+	char const *workload;
+	uint ops;
+	double secs;
+	HwStats hw;
+};
+
+// every backend there is, whether run by default or not
+constexpr char const *bench_backends[] = {
+	"sim", "sim-recorded",
+	"padconf", "padconf-uring", "padconf-sqpoll", "padconf-devmem",
+	"gpio", "gpio-x2",
+};
+
+let constexpr bench_max_workloads = 8u;	// per backend, see bench()
+let constexpr bench_max_results = countof( bench_backends ) * bench_max_workloads;
+
+let static results = array< BenchResult, bench_max_results > {};
+let static nresults = 0u;
+
+let static now() -> double
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// make AP accesses take the given number of TCK cycles, after the given number
+// of them, which only the simulated target can do
+let static ap_stalls( SimTarget &hw, uint latency, uint after ) -> bool
+{
+	hw.ap_latency = latency;
+	hw.ap_latency_after = after;
+	return true;
+}
+template< typename Hw >
+let static ap_stalls( Hw &hw, uint latency, uint after ) -> bool
+{
+	return false;
+}
+
+// run workload and record what it cost
+template< typename Hw, typename Fn >
+let static measure( char const *backend, Hw &hw, char const *workload,
+		uint ops, Fn &&fn )
+{
+	let before = hw.stats;
+	let t0 = now();
+	fn();
+	let t1 = now();
+	let after = hw.stats;
+
+	if( nresults == bench_max_results )
+		die( "too many results\n" );
+	results[ nresults++ ] = BenchResult { backend, workload, ops, t1 - t0, {
+		after.tck_cycles - before.tck_cycles,
+		after.pin_writes - before.pin_writes,
+		after.syscalls - before.syscalls,
+	} };
+}
+
+template< typename Hw >
+let static bench( char const *name, Hw &hw )
+{
+	hw.init();
+
+	let jtag = Jtag<Hw> { hw };
+	let chain = Chain<Hw> { jtag, chain_taps };
+	chain.init();
+	if( Hw::has_tdo ) {
+		check_chain( chain, discover_chain( chain ) );
+		icepick_discover( chain );
+	}
+	jtag.flush();
+
+	measure( name, hw, "tck_pulse", 10000, [&]() {
+		jtag.tap_goto( TapState::idle );
+		hw.tms( 0 );
+		forseq( i, 0u, 10000u )
+			jtag.tck_pulse();
+		jtag.flush();
+	} );
+
+	measure( name, hw, "xfer 32", 1000, [&]() {
+		let out = BitVec::zeros( 32 );
+		let in = BitVec {};
+		forseq( i, 0u, 1000u )
+			jtag.xfer( TapState::dr_shift, out, &in );
+		jtag.flush();
+	} );
+
+	measure( name, hw, "xfer 256", 200, [&]() {
+		let out = BitVec::zeros( 256 );
+		let in = BitVec {};
+		forseq( i, 0u, 200u )
+			jtag.xfer( TapState::dr_shift, out, &in );
+		jtag.flush();
+	} );
+
+	measure( name, hw, "xfer 4096", 20, [&]() {
+		let out = BitVec::zeros( 4096 );
+		let in = BitVec {};
+		forseq( i, 0u, 20u )
+			jtag.xfer( TapState::dr_shift, out, &in );
+		jtag.flush();
+	} );
+
+	icepick_init( chain, icepick_init_regs );
+
+	let dap = Dap<Hw> { chain };
+	dap.init();
+	dap_expect( dap.check(), name );
+
+	measure( name, hw, "dap_op", 1000, [&]() {
+		forseq( i, 0u, 1000u )
+			dap.dp_nop();
+		dap_expect( dap.check(), "dap_op" );
+		jtag.flush();
+	} );
+
+	measure( name, hw, "ap_read", 200, [&]() {
+		let addr = a8_debug;
+		u32 data;
+		forseq( i, 0u, 200u )
+			dap_expect( dap.ap_read( &addr, &data, 1 ), "ap_read" );
+		jtag.flush();
+	} );
+
+	measure( name, hw, "ap_read_block 256", 10, [&]() {
+		u32 data[ 256 ];
+		forseq( i, 0u, 10u )
+			dap_expect( dap.ap_read_block( a8_debug, data, 256 ), "ap_read_block" );
+		jtag.flush();
+	} );
+
+	// the same with the AP getting slow in the middle of a batch, which
+	// gets retried until the idle cycles after AP accesses catch up, with
+	// the idle cycles learned dropped every time.
+	if( ap_stalls( hw, 0, 0 ) ) {
+		measure( name, hw, "ap_read_block wait", 10, [&]() {
+			u32 data[ 256 ];
+			forseq( i, 0u, 10u ) {
+				ap_stalls( hw, 30, 16 );
+				dap.ap_current_timing() = ApTiming {};
+				dap_expect( dap.ap_read_block( a8_debug, data, 256 ),
+						"ap_read_block" );
+			}
+			jtag.flush();
+		} );
+		ap_stalls( hw, 0, 0 );
+	}
+}
+
+#ifndef JBANG_SIM
+// the raw JTAG workloads, each op shifting all chains at once
+template< uint nchains >
+let static bench_multi( char const *name, MultiJtag< nchains > &jtag )
+{
+	jtag.init();
+	let ids = jtag.init_chains();
+	forseq( c, 0u, nchains )
+		if( ( ids[ c ] & idcode_mask ) != idcode_match )
+			die( "%s: chain %u: device not recognized (JTAG ID %08x)\n",
+					name, c, ids[ c ] );
+
+	let xfer_bits = [&]( uint nbits ) {
+		typename MultiJtag< nchains >::Words in[ 4096 / 64 ];
+		jtag.xfer( TapState::dr_shift, nbits, NULL, in );
+	};
+
+	measure( name, jtag, "xfer 32", 1000, [&]() {
+		forseq( i, 0u, 1000u )
+			xfer_bits( 32 );
+		jtag.flush();
+	} );
+
+	measure( name, jtag, "xfer 256", 200, [&]() {
+		forseq( i, 0u, 200u )
+			xfer_bits( 256 );
+		jtag.flush();
+	} );
+
+	measure( name, jtag, "xfer 4096", 20, [&]() {
+		forseq( i, 0u, 20u )
+			xfer_bits( 4096 );
+		jtag.flush();
+	} );
+}
+#endif
+
+
+//-------------- Reporting ---------------------------------------------------//
+
+let static per_op( u64 x, uint ops ) -> double
+{
+	return (double) x / ops;
+}
+
+
+let static print_table()
+{
+	printf( "%-14s %-18s %6s %12s %12s %12s %10s %10s %10s\n",
+			"backend", "workload", "ops", "us/op", "ops/s",
+			"TCK/s", "TCK/op", "writes/op", "sys/op" );
+
+	forseq( i, 0u, nresults ) {
+		let &r = results[ i ];
+		printf( "%-14s %-18s %6u %12.3f %12.0f %12.0f %10.1f %10.1f %10.2f\n",
+				r.backend, r.workload, r.ops,
+				r.secs * 1e6 / r.ops, r.ops / r.secs,
+				r.hw.tck_cycles / r.secs,
+				per_op( r.hw.tck_cycles, r.ops ),
+				per_op( r.hw.pin_writes, r.ops ),
+				per_op( r.hw.syscalls, r.ops ) );
+	}
+}
+
+let static write_json( char const *path )
+{
+	let f = fopen( path, "w" );
+	if( ! f )
+		die( "%s: %m\n", path );
+
+	fprintf( f, "[\n" );
+	forseq( i, 0u, nresults ) {
+		let &r = results[ i ];
+		fprintf( f, "  { \"backend\": \"%s\", \"workload\": \"%s\", \"ops\": %u, "
+				"\"secs\": %.9f, \"tck_cycles\": %llu, "
+				"\"pin_writes\": %llu, \"syscalls\": %llu }%s\n",
+				r.backend, r.workload, r.ops, r.secs,
+				(unsigned long long) r.hw.tck_cycles,
+				(unsigned long long) r.hw.pin_writes,
+				(unsigned long long) r.hw.syscalls,
+				i + 1 < nresults ? "," : "" );
+	}
+	fprintf( f, "]\n" );
+	fclose( f );
+}
+
+
+//-------------- main --------------------------------------------------------//
+
+let static sim = SimTarget {};
+
+// the same, recording its pins to nowhere, for what recording costs
+let static sim_recorded = Recorded< SimTarget > {};
+let static recorder = WaveRecorder {};
+#ifndef JBANG_SIM
+let static padconf = Padconf {};
+let static padconf_uring = Padconf {};
+let static padconf_sqpoll = Padconf {};
+let static padconf_devmem = Padconf {};
+let static gpio = Gpio {};
+
+// a second board next to the one wired for the gpio backend
+let static gpio_x2 = MultiJtag<2> { {
+	Gpio::io_tck, Gpio::io_trst,
+	{ Gpio::io_tms, 1.17_io },
+	{ Gpio::io_tdi, 1.18_io },
+	{ Gpio::io_tdo, 1.19_io },
+} };
+#endif
+
+#ifndef JBANG_SIM
+let static bench_padconf( char const *name, Padconf &hw, PrivilegedEngine writer )
+{
+	hw.writer = writer;
+	hw.writer_auto = false;
+	bench( name, hw );
+}
+#endif
+
+let main( int argc, char **argv ) -> int
+{
+	let json = (char const *) NULL;
+	if( argc > 2 && ! strcmp( argv[ 1 ], "-j" ) ) {
+		json = argv[ 2 ];
+		argc -= 2;
+		argv += 2;
+	}
+
+	forseq( i, 1, argc ) {
+		let known = false;
+		for( let name : bench_backends )
+			known = known || ! strcmp( argv[ i ], name );
+		if( ! known )
+			die( "unknown backend \"%s\"\n", argv[ i ] );
+	}
+
+	let wanted = [&]( char const *name, bool by_default = true ) {
+		if( argc <= 1 )
+			return by_default;
+		forseq( i, 1, argc )
+			if( ! strcmp( argv[ i ], name ) )
+				return true;
+		return false;
+	};
+
+	if( wanted( "sim" ) )
+		bench( "sim", sim );
+	if( wanted( "sim-recorded", false ) ) {
+		recorder.open( "/dev/null" );
+		sim_recorded.recorder = &recorder;
+		bench( "sim-recorded", sim_recorded );
+		recorder.close();
+	}
+#ifndef JBANG_SIM
+	if( wanted( "padconf" ) )
+		bench_padconf( "padconf", padconf, PrivilegedEngine::vm_readv );
+	if( wanted( "padconf-uring" ) )
+		bench_padconf( "padconf-uring", padconf_uring, PrivilegedEngine::uring );
+	if( wanted( "padconf-sqpoll" ) )
+		bench_padconf( "padconf-sqpoll", padconf_sqpoll, PrivilegedEngine::uring_sqpoll );
+	if( wanted( "padconf-devmem" ) )
+		bench_padconf( "padconf-devmem", padconf_devmem, PrivilegedEngine::dev_mem );
+	if( wanted( "gpio", false ) )
+		bench( "gpio", gpio );
+	if( wanted( "gpio-x2", false ) )
+		bench_multi( "gpio-x2", gpio_x2 );
+#endif
+
+	print_table();
+	if( json )
+		write_json( json );
+
+	return 0;
+}
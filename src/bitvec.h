@@ -0,0 +1,127 @@
+#pragma once
+#include "defs.h"
+#include "die.h"
+
+//-------------- Bit vectors -------------------------------------------------//
+//
+// Scan data of arbitrary length (up to bitvec_max_bits), such as a boundary
+// scan register or the concatenated registers of several TAPs in a chain.
+//
+// Bits are packed lsb first into 64-bit words, bit 0 being the first one
+// shifted in and out, so a vector can be built and taken apart a word at a
+// time rather than bit by bit.  Bits beyond the length are always zero.
+
+let constexpr bitvec_max_bits = 4096u;
+
+struct BitVec {
+	let static constexpr max_words = bitvec_max_bits / 64;
+
+	array< u64, max_words > words {};
+	uint len = 0;
+
+	BitVec() = default;
+
+	// the low nbits (at most 64) of value
+	BitVec( uint nbits, u64 value ) {  append( nbits, value );  }
+
+	let static zeros( uint nbits ) -> BitVec {
+		if( nbits > bitvec_max_bits )
+			die( "bit vector too long (%u bits)\n", nbits );
+		let v = BitVec {};
+		v.len = nbits;
+		return v;
+	}
+
+	let static ones( uint nbits ) -> BitVec {
+		let v = BitVec {};
+		while( v.len < nbits )
+			v.append( min( nbits - v.len, 64u ), ~(u64) 0 );
+		return v;
+	}
+
+	let nwords() const -> uint {  return ( len + 63 ) / 64;  }
+
+	let bit( uint i ) const -> bool {  return words[ i / 64 ] >> i % 64 & 1;  }
+
+	let set( uint i, bool value ) -> void {
+		if( i >= len )
+			die( "bit %u beyond end of %u-bit vector\n", i, len );
+		let mask = (u64) 1 << i % 64;
+		words[ i / 64 ] = value ? words[ i / 64 ] | mask : words[ i / 64 ] & ~mask;
+	}
+
+	// n (at most 64) bits starting at pos, as an integer
+	let get( uint pos, uint n = 64 ) const -> u64 {
+		if( n == 0 || pos >= len )
+			return 0;
+		let w = pos / 64;
+		let b = pos % 64;
+		let x = words[ w ] >> b;
+		if( b && w + 1 < max_words )
+			x |= words[ w + 1 ] << ( 64 - b );
+		return n < 64 ? x & ( ( (u64) 1 << n ) - 1 ) : x;
+	}
+
+	// append n (at most 64) bits of value, to be shifted after the others
+	let append( uint n, u64 value ) -> BitVec & {
+		if( n == 0 )
+			return self;
+		if( n > 64 || len + n > bitvec_max_bits )
+			die( "bit vector too long (%u + %u bits)\n", len, n );
+		if( n < 64 )
+			value &= ( (u64) 1 << n ) - 1;
+		let w = len / 64;
+		let b = len % 64;
+		words[ w ] |= value << b;
+		if( b && b + n > 64 )
+			words[ w + 1 ] |= value >> ( 64 - b );
+		len += n;
+		return self;
+	}
+
+	// concatenation
+	let append( BitVec const &v ) -> BitVec & {
+		for( uint pos = 0; pos < v.len; pos += 64 )
+			append( min( v.len - pos, 64u ), v.get( pos ) );
+		return self;
+	}
+
+	// n bits starting at pos
+	let slice( uint pos, uint n ) const -> BitVec {
+		if( pos > len || n > len - pos )
+			die( "slice [%u,+%u) beyond end of %u-bit vector\n", pos, n, len );
+		let v = BitVec {};
+		for( uint i = 0; i < n; i += 64 )
+			v.append( min( n - i, 64u ), get( pos + i ) );
+		return v;
+	}
+
+	// shift register view:  bits go in at the end and come out at bit 0
+	let shift_in( bool value ) -> void {  append( 1, value );  }
+
+	let shift_out() -> bool {
+		if( len == 0 )
+			die( "shift out of empty bit vector\n" );
+		let out = bit( 0 );
+		let n = nwords();
+		forseq( w, 0u, n )
+			words[ w ] = words[ w ] >> 1 |
+				( w + 1 < n ? words[ w + 1 ] << 63 : 0 );
+		--len;
+		return out;
+	}
+
+	let operator == ( BitVec const &v ) const -> bool {
+		if( len != v.len )
+			return false;
+		forseq( w, 0u, nwords() )
+			if( words[ w ] != v.words[ w ] )
+				return false;
+		return true;
+	}
+	let operator != ( BitVec const &v ) const -> bool {  return ! ( self == v );  }
+};
+
+let inline operator + ( BitVec a, BitVec const &b ) -> BitVec {
+	return a.append( b );
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include "defs.h"
+#include "die.h"
+#include "jtag.h"
+#include "bitvec.h"
+#include "translog.h"
+#include <string.h>
+
+
+//-------------- Scan chain model --------------------------------------------//
+//
+// The TAPs of a chain are described by a table, in scan order:  the TAP nearest
+// TDO comes first, since the first bits shifted in end up there.  Scans then
+// target a single TAP, and the chain takes care of the rest:
+//
+//	- instructions are selected per TAP and only scanned in when a DR scan
+//	  needs them, all TAPs at once, and only if any of them changes
+//	- for a DR scan of one TAP, all others are put in BYPASS and padded
+//	  with their 1-bit bypass registers
+//	- the data captured is taken out of the chain's, so the handle of a
+//	  capture resolves to just the TAP's own bits
+//
+// TAPs behind an ICEPick (icepick_reg != 0) are only part of the chain once
+// linked in, see icepick_init().  Which secondary TAP register links a TAP in
+// can also be found out, see icepick_discover().  After a TAP reset, or when
+// linked, a TAP's instruction is its ir_reset (IDCODE, or BYPASS if it has
+// none).
+//
+// The table can be checked against the chain itself, see discover.h.
+//
+// The transactions on the chain can be logged, see translog.h.
+
+let constexpr icepick_reg_unknown = ~0u;  // not found behind the icepick
+
+struct TapDesc {
+	char const *name;
+	uint ir_len;
+	u64 ir_bypass;
+	u64 ir_reset;
+	u32 idcode;		// 0 if it has none
+	uint icepick_reg;	// secondary TAP register linking it in (or 0)
+
+	// whether an IDCODE read from the chain is this TAP's (of any version)
+	let matches( u32 id ) const -> bool {
+		return ( ( id ^ idcode ) & 0x0fff'ffff ) == 0;
+	}
+};
+
+let constexpr chain_max_taps = 8u;
+
+template< typename Hw >
+struct Chain {
+	Jtag<Hw> &jtag;
+	TapDesc const *const taps;
+	uint const ntaps;
+
+	array< bool, chain_max_taps > linked {};
+	array< u64, chain_max_taps > ir {};		// as last scanned in
+	array< u64, chain_max_taps > selected {};	// for the next DR scan
+	array< uint, chain_max_taps > icepick_reg {};	// as given or discovered
+
+	TransLog *translog = NULL;
+
+	template< size_t n >
+	Chain( Jtag<Hw> &jtag, TapDesc const (&taps)[ n ] )
+		: jtag( jtag ), taps( taps ), ntaps( n )
+	{
+		static_assert( n <= chain_max_taps, "" );
+		forseq( t, 0u, ntaps )
+			icepick_reg[ t ] = taps[ t ].icepick_reg;
+		reset_state();
+	}
+
+	let find( char const *name ) const -> uint
+	{
+		forseq( t, 0u, ntaps )
+			if( ! strcmp( taps[ t ].name, name ) )
+				return t;
+		die( "no TAP \"%s\" in chain\n", name );
+	}
+
+	// TAPs as after a TAP reset
+	let reset_state() -> void
+	{
+		forseq( t, 0u, ntaps ) {
+			linked[ t ] = taps[ t ].icepick_reg == 0;
+			ir[ t ] = selected[ t ] = taps[ t ].ir_reset;
+		}
+	}
+
+	// reset the TAPs and read the IDCODE of the chain (see Jtag::init)
+	let init() -> u32
+	{
+		let idcode = jtag.init();
+		reset_state();
+		if( translog )
+			translog->record( jtag, TransRecord { TransKind::reset, 0, 0, 0, 0, idcode } );
+		return idcode;
+	}
+
+	// a TAP has been linked into the chain
+	let link( uint t ) -> void
+	{
+		linked[ t ] = true;
+		ir[ t ] = selected[ t ] = taps[ t ].ir_reset;
+		if( translog )
+			translog->record( jtag, TransRecord { TransKind::link, (u8) t, 0, 0, 0, 0 } );
+	}
+
+	// select the instruction of a TAP for its next DR scan
+	let select( uint t, u64 code ) -> void
+	{
+		selected[ t ] = code;
+	}
+
+	// bring the instructions up to date for a DR scan of TAP t, with a
+	// single IR scan if anything changes
+	let update_ir( uint t ) -> void
+	{
+		let changed = false;
+		forseq( i, 0u, ntaps ) {
+			let code = i == t ? selected[ i ] : taps[ i ].ir_bypass;
+			if( linked[ i ] && ir[ i ] != code ) {
+				ir[ i ] = code;
+				changed = true;
+			}
+		}
+		if( ! changed )
+			return;
+
+		let bits = BitVec {};
+		forseq( i, 0u, ntaps )
+			if( linked[ i ] )
+				bits.append( taps[ i ].ir_len, ir[ i ] );
+		if( bits.len <= 64 )
+			jtag.scan_ir( bits.len, bits.get( 0 ) );
+		else
+			jtag.scan_ir( bits );
+	}
+
+	// bypass bits before and after TAP t
+	let pad_before( uint t ) const -> uint
+	{
+		let n = 0u;
+		forseq( i, 0u, t )
+			n += linked[ i ];
+		return n;
+	}
+	let pad_after( uint t ) const -> uint
+	{
+		let n = 0u;
+		forseq( i, t + 1, ntaps )
+			n += linked[ i ];
+		return n;
+	}
+
+	// log idle cycles queued as part of a transaction
+	let log_idle( uint ncycles ) -> void
+	{
+		if( translog && ncycles )
+			translog->record( jtag, TransRecord { TransKind::idle, 0, 0, 0, ncycles, 0 } );
+	}
+
+	// queue a DR scan of TAP t
+	let scan_dr( uint t, uint nbits, u64 out = 0 ) -> void
+	{
+		if( ! linked[ t ] )
+			die( "TAP %s not in chain\n", taps[ t ].name );
+		update_ir( t );
+		let before = pad_before( t );
+		let total = before + nbits + pad_after( t );
+		if( total <= 64 ) {
+			jtag.scan_dr( total, out << before );
+			return;
+		}
+		let bits = BitVec::zeros( before );
+		bits.append( nbits, out );
+		bits.append( BitVec::zeros( total - bits.len ) );
+		jtag.scan_dr( bits );
+	}
+
+	// same, returning a handle to the TAP's captured data
+	let capture_dr( uint t, uint nbits, u64 out = 0 ) -> Scan
+	{
+		if( ! linked[ t ] )
+			die( "TAP %s not in chain\n", taps[ t ].name );
+		update_ir( t );
+		let before = pad_before( t );
+		let total = before + nbits + pad_after( t );
+		if( total > 64 )
+			die( "capture of %u bits through %u-bit chain too long\n", nbits, total );
+		let scan = jtag.capture_dr( total, out << before );
+		scan.pos = (u8) before;
+		scan.nbits = (u8) nbits;
+		return scan;
+	}
+};
@@ -1,4 +1,9 @@
+#pragma once
 #include "defs.h"
+#include "die.h"
+#include "jtag.h"
+#include "chain.h"
+#include <stdio.h>
 
 namespace dap {
 
@@ -29,6 +34,25 @@ enum {
 	dp_rd_null	= 0x7,
 };
 
+enum : u32 {
+	// dp ctrl/stat
+	ctrl_orundetect		= 1 << 0,
+	ctrl_stickyorun		= 1 << 1,
+	ctrl_stickycmp		= 1 << 4,
+	ctrl_stickyerr		= 1 << 5,
+	ctrl_sticky		= ctrl_stickyorun | ctrl_stickycmp | ctrl_stickyerr,
+	ctrl_cdbgpwrupreq	= 1 << 28,
+	ctrl_cdbgpwrupack	= 1 << 29,
+	ctrl_csyspwrupreq	= 1 << 30,
+	ctrl_csyspwrupack	= 1u << 31,
+};
+
+enum {
+	// 3-bit ack in response to dpacc/apacc
+	ack_ok_fault	= 0b010,
+	ack_wait	= 0b001,
+};
+
 enum {
 	// ir_apacc
 	ap_wr_csw	= 0x0,
@@ -39,4 +63,684 @@ enum {
 	ap_rd_data	= 0x7,
 };
 
+enum {
+	// MEM-AP control/status word
+	csw_size_8	= 0 << 0,
+	csw_size_16	= 1 << 0,
+	csw_size_32	= 2 << 0,
+	csw_inc_off	= 0 << 4,	// TAR fixed
+	csw_inc_single	= 1 << 4,	// TAR += size after each DRW access
+	csw_inc_packed	= 2 << 4,
+	csw_inc_mask	= 3 << 4,
+};
+
+// TAR auto-increment is only guaranteed to work within a 1 KiB block
+let constexpr tar_inc_range = 0x400u;
+
 } // namespace dap
+
+
+//-------------- ARM Debug Access Port (DAP) ---------------------------------//
+//
+// JTAG-DP, the TAP named "dap" of the scan chain (see chain.h), which puts any
+// other TAPs in bypass.
+
+// Shadow copies of the registers that determine where an access goes, so that
+// writes of the value a register already holds can be skipped.  The TAR shadow
+// follows auto-increment, but becomes unknown when it leaves the 1 KiB range
+// within which auto-increment is guaranteed.
+
+struct DapShadow {
+	u32 value;
+	bool valid;
+
+	let holds( u32 x ) const -> bool {  return valid && value == x;  }
+	let set( u32 x ) -> void {  value = x;  valid = true;  }
+	let invalidate() -> void {  valid = false;  }
+};
+
+// Run-Test/Idle cycles to insert after each access to an AP, to give the access
+// time to complete before the next scan.  Padconf bit-banging is slow enough
+// that the APB-AP never needs any, but a faster backend might.
+//
+// This is learned from WAIT responses:  every retry needed doubles the number
+// of cycles (so even a slow AP is caught up with within the retry limit), and
+// after a run of batches without any WAIT one is taken away again to see if
+// it's still needed.
+
+struct ApTiming {
+	u8 idle;
+	u8 clean;	// batches without WAIT since last change
+};
+
+let constexpr ap_idle_max = 64u;
+let constexpr ap_idle_decay = 32u;
+
+
+// Batches.  Rather than checking the status of every op, the DP is configured
+// to detect overruns (ORUNDETECT):  once an op gets a WAIT response, it and all
+// AP accesses after it are discarded until the sticky flags are cleared.  The
+// same goes for an AP access that fails (STICKYERR).  So checking CTRL/STAT
+// once at the end of a batch suffices, and a whole batch can be sent down in
+// one flush.  Only when that check reports an error is the batch log used to
+// figure out which op failed.
+//
+// A batch is everything queued since the previous check().
+
+enum class DapErr : u8 {
+	ok,
+	wait,		// op kept getting WAIT responses (overrun)
+	fault,		// AP access failed (sticky error)
+	power,		// debug/system power-up not acknowledged
+	protocol,	// bogus ack, e.g. no TDO connected
+	timeout,	// ap_poll() condition not met
+};
+
+struct DapStatus {
+	DapErr err;
+	uint failed;	// index of failed op within batch, or ~0u if unknown
+	u32 ctrl;	// CTRL/STAT when the error was detected
+
+	let ok() const -> bool {  return err == DapErr::ok;  }
+};
+
+let constexpr dap_ok = DapStatus { DapErr::ok, ~0u, 0 };
+
+let inline dap_strerror( DapErr err ) -> char const *
+{
+	switch( err ) {
+	case DapErr::ok:	return "ok";
+	case DapErr::wait:	return "overrun (WAIT response)";
+	case DapErr::fault:	return "AP access failed";
+	case DapErr::power:	return "not powered up";
+	case DapErr::protocol:	return "invalid response";
+	case DapErr::timeout:	return "poll timed out";
+	}
+	return "?";
+}
+
+// for when there's nothing sensible to do about an error
+let inline dap_expect( DapStatus status, char const *what ) -> void
+{
+	if( status.ok() )
+		return;
+	if( status.failed != ~0u )
+		die( "%s: %s at op %u of batch (CTRL/STAT %08x)\n", what,
+				dap_strerror( status.err ), status.failed, status.ctrl );
+	die( "%s: %s (CTRL/STAT %08x)\n", what,
+			dap_strerror( status.err ), status.ctrl );
+}
+
+// CTRL/STAT value to keep written:  power-up requests, overrun detection
+let constexpr dap_ctrl = dap::ctrl_cdbgpwrupreq | dap::ctrl_csyspwrupreq |
+				dap::ctrl_orundetect;
+
+struct DapLogEntry {
+	Scan scan;
+	u8 ir;
+	u8 op;
+	bool has_addr;
+	u32 arg;
+	u32 addr;	// address of DRW access (if known)
+	Scan *result;	// where the result of a read goes
+};
+
+let constexpr dap_log_size = 512u;  // must be well below scan_results_size
+let constexpr dap_max_retries = 8u;
+
+// CSW used for all accesses, apart from the auto-increment mode
+let constexpr ap_csw_base = 0xe3000000 | dap::csw_size_32;
+
+let constexpr ap_pipeline_depth = 256u;  // keeps handles well within range
+
+
+template< typename Hw >
+struct Dap {
+	Chain<Hw> &chain;
+	Jtag<Hw> &jtag;
+	uint const tap;
+
+	explicit Dap( Chain<Hw> &chain )
+		: chain( chain ), jtag( chain.jtag ), tap( chain.find( "dap" ) ) {}
+
+	DapShadow dp_sel_shadow {};
+	DapShadow ap_csw_shadow {};
+	DapShadow ap_tar_shadow {};
+
+	let invalidate() -> void
+	{
+		dp_sel_shadow.invalidate();
+		ap_csw_shadow.invalidate();
+		ap_tar_shadow.invalidate();
+	}
+
+	array< ApTiming, 256 > ap_timing {};
+
+	// timing of the AP last selected.  the shadow's value is still the
+	// best guess when it's been invalidated, e.g. by recover().
+	let ap_current_timing() -> ApTiming &
+	{
+		return ap_timing[ dp_sel_shadow.value >> 24 ];
+	}
+
+	// The response to a dap op carries the result of the read preceding it,
+	// so the handle for the result of a read is only known once the next op
+	// is queued.  This points to where it needs to go.
+	Scan *read_result = NULL;
+
+	// queue the scan for a dap op, returns handle to its response.
+	let scan_op( uint ir, uint op, u32 arg ) -> Scan
+	{
+		// the chain only does an IR scan when the instruction changes
+		chain.select( tap, ir );
+		// 3-bit op/status, 32-bit data
+		let scan = chain.capture_dr( tap, 3 + 32, op | (u64) arg << 3 );
+		if( chain.translog )
+			chain.translog->record( jtag, TransRecord { TransKind::dap_op,
+					(u8) tap, (u8) ir, (u8) op, arg, 0 }, &scan );
+		if( ir == dap::ir_apacc ) {
+			jtag.scan_idle( ap_current_timing().idle );
+			chain.log_idle( ap_current_timing().idle );
+		}
+
+		if( read_result ) {
+			*read_result = scan;
+			read_result = NULL;
+		}
+		return scan;
+	}
+
+	let ack( Scan scan ) -> uint
+	{
+		return (uint) jtag.get( scan ) & 7;
+	}
+
+	// response data carried by a dap op
+	let response( Scan scan ) -> u32
+	{
+		return (u32)( jtag.get( scan ) >> 3 );
+	}
+
+
+	//-------- Batches
+
+	array< DapLogEntry, dap_log_size > batch_log {};
+	uint nlogged = 0;
+	uint batch_base = 0;		// ops of this batch no longer in log
+	DapStatus batch_status = dap_ok;  // of this batch so far
+
+	let static is_drw( DapLogEntry const &e ) -> bool
+	{
+		return e.ir == dap::ir_apacc && ( e.op & ~1 ) == dap::ap_wr_data;
+	}
+
+	// Replay the batch log from the op that got a WAIT response, since the
+	// DP has discarded it and everything after it.  The response to the
+	// stalled op would have carried the result of the read before it, so
+	// that read is redone too (rewinding TAR if needed).  Returns the index
+	// replay started at, or ~0u if replaying isn't possible.
+	//
+	// The results of the reads before that are pinned (see Jtag::pin), since
+	// with every retry of a long batch they'd fall further behind, and out
+	// of the results window.  So a batch never needs more than the log's
+	// worth of it, however often it's retried.
+	let replay( uint stalled ) -> uint
+	{
+		let from = stalled;
+		if( from > 0 && from <= nlogged && batch_log[ from - 1 ].result )
+			--from;
+		if( from < nlogged && is_drw( batch_log[ from ] ) &&
+				! batch_log[ from ].has_addr )
+			return ~0u;
+
+		forseq( i, 0u, min( from, nlogged ) )
+			if( batch_log[ i ].result )
+				*batch_log[ i ].result = jtag.pin( *batch_log[ i ].result );
+
+		scan_op( dap::ir_dpacc, dap::dp_wr_csw, dap_ctrl | dap::ctrl_sticky );
+
+		let &timing = ap_current_timing();
+		timing.idle = min( max( timing.idle * 2u, 1u ), ap_idle_max );
+		timing.clean = 0;
+
+		if( from < nlogged && is_drw( batch_log[ from ] ) )
+			scan_op( dap::ir_apacc, dap::ap_wr_addr, batch_log[ from ].addr );
+
+		forseq( i, from, nlogged ) {
+			let &e = batch_log[ i ];
+			e.scan = scan_op( e.ir, e.op, e.arg );
+			if( e.result )
+				read_result = e.result;
+		}
+		return from;
+	}
+
+	// Give up on a stalled batch:  abort the AP transaction that's stuck and
+	// clear the sticky flags so the DAP is usable again.
+	let recover() -> void
+	{
+		scan_op( dap::ir_abort, dap::dp_abort, 1 );
+		scan_op( dap::ir_dpacc, dap::dp_wr_csw, dap_ctrl | dap::ctrl_sticky );
+		invalidate();
+	}
+
+	// check CTRL/STAT and inspect the batch log if needed.  called by
+	// check(), and whenever the log fills up in the middle of a batch.
+	//
+	// A WAIT is retried a bounded number of times by replaying the log,
+	// every time with an extra idle cycle after AP accesses.
+	let batch_check() -> void
+	{
+		let err = DapErr::ok;
+		let failed = ~0u;
+		let x = 0u;
+
+		let start = 0u;  // log entries before this are known to be fine
+
+		for( uint retries = 0;; ) {
+			let check = scan_op( dap::ir_dpacc, dap::dp_rd_csw, 0 );
+			Scan ctrl;
+			read_result = &ctrl;
+			let last = scan_op( dap::ir_dpacc, dap::dp_rd_null, 0 );
+
+			if( ! Hw::has_tdo || ! batch_status.ok() )
+				break;
+
+			// this is where the whole batch gets flushed
+			x = response( ctrl );
+
+			// where the DP stopped if anything got a WAIT response
+			let stalled = ~0u;
+			let bogus = ~0u;
+			forseq( i, start, nlogged ) {
+				let a = ack( batch_log[ i ].scan );
+				if( a == dap::ack_ok_fault )
+					continue;
+				if( a == dap::ack_wait )
+					stalled = i;
+				else
+					bogus = i;
+				break;
+			}
+			if( stalled == ~0u && bogus == ~0u ) {
+				if( ack( check ) == dap::ack_wait )
+					stalled = nlogged;
+				else if( ack( last ) == dap::ack_wait )
+					stalled = nlogged + 1;
+			}
+
+			if( stalled != ~0u ) {
+				if( retries++ < dap_max_retries ) {
+					start = replay( stalled );
+					if( start != ~0u )
+						continue;
+				}
+				recover();
+				err = DapErr::wait;
+				if( stalled < nlogged )
+					failed = stalled;
+				break;
+			}
+
+			if( bogus != ~0u ) {
+				err = DapErr::protocol;
+				failed = bogus;
+			} else if( ack( check ) != dap::ack_ok_fault ||
+					ack( last ) != dap::ack_ok_fault ) {
+				err = DapErr::protocol;
+			} else if( x & dap::ctrl_stickyorun ) {
+				// overrun without any WAIT response we know of
+				err = DapErr::wait;
+				recover();
+			} else if( x & ( dap::ctrl_stickyerr | dap::ctrl_stickycmp ) ) {
+				// TAR was not incremented past the failing access
+				err = DapErr::fault;
+				scan_op( dap::ir_dpacc, dap::dp_wr_csw,
+						dap_ctrl | dap::ctrl_sticky );
+				let tar = tar_read();
+				forseq( i, 0u, nlogged ) {
+					let &e = batch_log[ i ];
+					if( e.has_addr && e.addr == tar ) {
+						failed = i;
+						break;
+					}
+				}
+			} else if( ( x & 0xf0000000 ) != 0xf0000000 ) {
+				err = DapErr::power;
+			}
+
+			if( retries == 0 && err == DapErr::ok ) {
+				let &timing = ap_current_timing();
+				if( timing.idle && ++timing.clean == ap_idle_decay ) {
+					timing.idle--;
+					timing.clean = 0;
+				}
+			}
+			break;
+		}
+
+		if( err != DapErr::ok )
+			batch_status = DapStatus { err,
+				failed == ~0u ? ~0u : batch_base + failed, x };
+
+		batch_base += nlogged;
+		nlogged = 0;
+	}
+
+	// queue a dap op, returns handle to its response.
+	//
+	// once the batch has failed there's no point:  the DP discards AP
+	// accesses anyway, so ops are dropped until the end of the batch.
+	let queue( uint ir, uint op, u32 arg ) -> Scan
+	{
+		if( ! batch_status.ok() )
+			return jtag.dummy_scan();
+		if( nlogged == dap_log_size )
+			batch_check();
+
+		let scan = scan_op( ir, op, arg );
+		batch_log[ nlogged++ ] = DapLogEntry { scan, (u8) ir, (u8) op, false, arg, 0, NULL };
+		return scan;
+	}
+
+	// queue a read op.  the handle is filled in when the next dap op is
+	// queued, so it needs to stay around until then.
+	let queue_read( uint ir, uint op, Scan &result ) -> void
+	{
+		queue( ir, op, 0 );
+		if( batch_status.ok() ) {
+			read_result = &result;
+			batch_log[ nlogged - 1 ].result = &result;
+		} else {
+			result = jtag.dummy_scan();
+		}
+	}
+
+
+	// predict TAR after a DRW access
+	let ap_tar_advance() -> void
+	{
+		if( ! ap_tar_shadow.valid )
+			return;
+		if( ! ap_csw_shadow.valid ) {
+			ap_tar_shadow.invalidate();
+			return;
+		}
+
+		let csw = ap_csw_shadow.value;
+		let tar = ap_tar_shadow.value;
+		switch( csw & dap::csw_inc_mask ) {
+		case dap::csw_inc_off:
+			return;
+		case dap::csw_inc_single:
+			ap_tar_shadow.value = tar + ( 1 << ( csw & 7 ) );
+			if( ( ap_tar_shadow.value ^ tar ) & -dap::tar_inc_range )
+				ap_tar_shadow.invalidate();
+			return;
+		default:
+			ap_tar_shadow.invalidate();
+		}
+	}
+
+	// note the address of the DRW access just queued in the batch log
+	let ap_log_addr() -> void
+	{
+		if( ! ap_tar_shadow.valid || ! batch_status.ok() )
+			return;
+		let &e = batch_log[ nlogged - 1 ];
+		e.has_addr = true;
+		e.addr = ap_tar_shadow.value;
+	}
+
+
+	//-------- Registers
+
+	let dp_abort() -> void
+	{
+		queue( dap::ir_abort, dap::dp_abort, 1 );
+		ap_tar_shadow.invalidate();  // aborted access may or may not have happened
+	}
+
+	let dp_csw( u32 x ) -> void      {  queue( dap::ir_dpacc, dap::dp_wr_csw, x );  }
+	let dp_csw( Scan &res ) -> void  {  queue_read( dap::ir_dpacc, dap::dp_rd_csw, res );  }
+
+	let dp_sel( u32 x ) -> void
+	{
+		if( dp_sel_shadow.holds( x ) )
+			return;
+		// AP registers are per AP
+		if( ! dp_sel_shadow.valid || ( dp_sel_shadow.value ^ x ) >> 24 ) {
+			ap_csw_shadow.invalidate();
+			ap_tar_shadow.invalidate();
+		}
+		queue( dap::ir_dpacc, dap::dp_wr_sel, x );
+		dp_sel_shadow.set( x );
+	}
+
+	// read of RDBUFF:  just returns the result of the previous read
+	let dp_nop() -> void  {  queue( dap::ir_dpacc, dap::dp_rd_null, 0 );  }
+
+	let ap_csw( u32 x ) -> void
+	{
+		if( ap_csw_shadow.holds( x ) )
+			return;
+		queue( dap::ir_apacc, dap::ap_wr_csw, x );
+		ap_csw_shadow.set( x );
+	}
+	let ap_csw( Scan &res ) -> void  {  queue_read( dap::ir_apacc, dap::ap_rd_csw, res );  }
+
+	let ap_addr( u32 x ) -> void
+	{
+		if( ap_tar_shadow.holds( x ) )
+			return;
+		queue( dap::ir_apacc, dap::ap_wr_addr, x );
+		ap_tar_shadow.set( x );
+	}
+	let ap_addr( Scan &res ) -> void  {  queue_read( dap::ir_apacc, dap::ap_rd_addr, res );  }
+
+	let ap_data( u32 x ) -> void
+	{
+		queue( dap::ir_apacc, dap::ap_wr_data, x );
+		ap_log_addr();
+		ap_tar_advance();
+	}
+	let ap_data( Scan &res ) -> void
+	{
+		queue_read( dap::ir_apacc, dap::ap_rd_data, res );
+		ap_log_addr();
+		ap_tar_advance();
+	}
+
+	// read TAR outside of any batch bookkeeping (used to locate a failed
+	// access)
+	let tar_read() -> u32
+	{
+		Scan tar;
+		scan_op( dap::ir_apacc, dap::ap_rd_addr, 0 );
+		read_result = &tar;
+		scan_op( dap::ir_dpacc, dap::dp_rd_null, 0 );
+		ap_tar_shadow.invalidate();
+		return response( tar );
+	}
+
+	// end the batch:  drain the read pipeline and check for errors.  if the
+	// batch failed, the sticky flags are cleared so the next one can proceed.
+	let check() -> DapStatus
+	{
+		batch_check();
+
+		let status = batch_status;
+		if( ! status.ok() ) {
+			read_result = NULL;
+			if( status.err != DapErr::fault )  // already cleared
+				scan_op( dap::ir_dpacc, dap::dp_wr_csw,
+						dap_ctrl | dap::ctrl_sticky );
+			invalidate();
+		}
+
+		batch_status = dap_ok;
+		batch_base = 0;
+		return status;
+	}
+
+	let init() -> void
+	{
+		if( Hw::has_tdo ) {
+			chain.select( tap, dap::ir_idcode );
+			let idcode = (u32) jtag.get( chain.capture_dr( tap, 32 ) );
+			printf( "DAP JTAG ID: %08x\n", idcode );
+			if( idcode != 0x3ba00477 )
+				die( "Device not recognized" );
+		}
+
+		invalidate();
+
+		// power up, enable overrun detection, and clear errors
+		dp_csw( dap_ctrl | dap::ctrl_sticky );
+		dap_expect( check(), "DAP init" );
+
+		// select and configure APB-AP:  32-bit accesses, TAR auto-increment
+		dp_sel( 1 << 24 );
+		ap_csw( ap_csw_base | dap::csw_inc_single );
+	}
+
+
+	//-------- Memory access
+	//
+	// Pipelined reads.  Since every dap op returns the result of the
+	// previous read, there's no need to drain the pipeline after each read:
+	// the next op, whatever it is, picks up the data.  Only the last read
+	// needs an extra scan to retrieve its result, and check() already does
+	// that.
+	//
+	// This takes at most 2 scans per read plus 2 at the end, rather than 4
+	// per read.  When an address follows on from the previous one, TAR
+	// auto-increment takes care of it and the read is just 1 scan.
+
+	let ap_read( u32 const *addrs, u32 *data, uint n ) -> DapStatus
+	{
+		ap_csw( ap_csw_base | dap::csw_inc_single );
+
+		while( n ) {
+			let count = min( n, ap_pipeline_depth );
+
+			Scan res[ ap_pipeline_depth ];
+			forseq( i, 0u, count ) {
+				ap_addr( addrs[ i ] );
+				ap_data( res[ i ] );
+			}
+			let status = check();
+			if( ! status.ok() )
+				return status;
+			forseq( i, 0u, count )
+				data[ i ] = response( res[ i ] );
+
+			addrs += count;
+			data += count;
+			n -= count;
+		}
+		return dap_ok;
+	}
+
+	let ap_read( u32 addr ) -> u32
+	{
+		u32 data;
+		dap_expect( ap_read( &addr, &data, 1 ), "ap_read" );
+		if( Hw::has_tdo )
+			printf( "read 0x%08x -> 0x%08x\n", addr, data );
+		return data;
+	}
+
+	let ap_write( u32 addr, u32 data ) -> void
+	{
+		ap_csw( ap_csw_base | dap::csw_inc_single );
+		ap_addr( addr );
+		ap_data( data );
+		dap_expect( check(), "ap_write" );
+	}
+
+	// Block transfers of consecutive words.  Thanks to TAR auto-increment
+	// only the first access needs a TAR write, after that it's one DRW scan
+	// per word.  TAR is rewritten at every 1 KiB boundary since
+	// auto-increment isn't guaranteed to carry beyond that.
+
+	let static ap_block_count( u32 addr, uint n ) -> uint
+	{
+		if( addr & 3 )
+			die( "unaligned block transfer at 0x%08x\n", addr );
+		let room = ( dap::tar_inc_range - ( addr & ( dap::tar_inc_range - 1 ) ) ) / 4;
+		return min( min( n, room ), ap_pipeline_depth );
+	}
+
+	let ap_read_block( u32 addr, u32 *data, uint n ) -> DapStatus
+	{
+		ap_csw( ap_csw_base | dap::csw_inc_single );
+
+		while( n ) {
+			let count = ap_block_count( addr, n );
+
+			Scan res[ ap_pipeline_depth ];
+			ap_addr( addr );
+			forseq( i, 0u, count )
+				ap_data( res[ i ] );
+			let status = check();
+			if( ! status.ok() )
+				return status;
+			forseq( i, 0u, count )
+				data[ i ] = response( res[ i ] );
+
+			addr += count * 4;
+			data += count;
+			n -= count;
+		}
+		return dap_ok;
+	}
+
+	let ap_write_block( u32 addr, u32 const *data, uint n ) -> DapStatus
+	{
+		ap_csw( ap_csw_base | dap::csw_inc_single );
+
+		while( n ) {
+			let count = ap_block_count( addr, n );
+
+			ap_addr( addr );
+			forseq( i, 0u, count )
+				ap_data( data[ i ] );
+			let status = check();
+			if( ! status.ok() )
+				return status;
+
+			addr += count * 4;
+			data += count;
+			n -= count;
+		}
+		return dap_ok;
+	}
+
+	// Poll a register until ( value & mask ) == match, giving up after the
+	// given number of reads.  Auto-increment is turned off so that TAR and
+	// CSW need no rewriting, which leaves a single DRW scan per poll (its
+	// result arrives with the next one).  Note that this means the register
+	// is read once more after the match, so don't use this on registers with
+	// read side-effects.
+	//
+	let ap_poll( u32 addr, u32 mask, u32 match, uint tries ) -> DapStatus
+	{
+		ap_csw( ap_csw_base | dap::csw_inc_off );
+		ap_addr( addr );
+
+		Scan res[ 2 ];
+		ap_data( res[ 0 ] );
+		forseq( i, 0u, tries ) {
+			ap_data( res[ ( i + 1 ) & 1 ] );  // carries result of read i
+			if( ! batch_status.ok() )
+				break;
+			if( ( response( res[ i & 1 ] ) & mask ) == match )
+				return check();
+		}
+		let status = check();
+		if( status.ok() )
+			status.err = DapErr::timeout;
+		return status;
+	}
+};
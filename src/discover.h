@@ -0,0 +1,136 @@
+#pragma once
+#include "defs.h"
+#include "die.h"
+#include "jtag.h"
+#include "chain.h"
+#include "bitvec.h"
+#include <stdio.h>
+
+
+//-------------- Scan chain discovery ----------------------------------------//
+//
+// Finds out what's in the chain from the chain itself, relying only on what
+// IEEE 1149.1 guarantees of every TAP:
+//
+//	- after a TAP reset, the DR is either the 32-bit IDCODE register (whose
+//	  lsb is 1) or the 1-bit BYPASS register (which captures 0).  Shifting
+//	  ones through the DR yields the IDCODEs and bypass bits of all TAPs,
+//	  nearest TDO first, followed by the ones shifted in (not a valid IDCODE).
+//
+//	- the all-ones instruction is BYPASS.  Filling the IRs with zeros and
+//	  then shifting in ones, the first one comes out after as many bits as
+//	  the IRs have in total.  Before the zeros, the IR data captured comes
+//	  out, each TAP's ending in 01, which usually tells where one TAP's IR
+//	  ends and the next one's begins.
+//
+// The scans are sized for chain_max_taps TAPs with IRs of up to 32 bits each.
+
+let constexpr discover_ir_max = chain_max_taps * 32;
+
+struct ChainInfo {
+	uint ntaps = 0;
+	uint ir_total = 0;
+	u32 idcode[ chain_max_taps ] {};	// 0 if it has none
+	uint ir_len[ chain_max_taps ] {};	// 0 if it can't be told
+};
+
+// enumerate the TAPs in the chain, which must be in their reset state (i.e.
+// have just been reset or linked).  this leaves them all in BYPASS.
+template< typename Hw >
+let discover_chain( Jtag<Hw> &jtag ) -> ChainInfo
+{
+	let info = ChainInfo {};
+
+	let ids = BitVec {};
+	jtag.scan_dr( BitVec::ones( ( chain_max_taps + 1 ) * 32 ), &ids );
+	let pos = 0u;
+	while( ids.get( pos, 32 ) != 0xffff'ffff ) {
+		if( info.ntaps == chain_max_taps )
+			die( "scan chain too long (or TDO stuck low)\n" );
+		let bypass = ! ids.bit( pos );
+		info.idcode[ info.ntaps++ ] = bypass ? 0 : (u32) ids.get( pos, 32 );
+		pos += bypass ? 1 : 32;
+	}
+	if( info.ntaps == 0 )
+		die( "no TAPs in scan chain (or TDO stuck high)\n" );
+
+	let ir = BitVec {};
+	jtag.scan_ir( BitVec::zeros( discover_ir_max ) + BitVec::ones( discover_ir_max ), &ir );
+	let n = 0u;
+	while( n < discover_ir_max && ! ir.bit( discover_ir_max + n ) )
+		++n;
+	if( n < 2 * info.ntaps || n == discover_ir_max )
+		die( "scan chain IR length inconsistent (%u bits for %u TAPs)\n",
+				n, info.ntaps );
+	info.ir_total = n;
+
+	// where the captured IRs start:  at each 1 followed by a 0.  a TAP may
+	// capture more of those, in which case the split is ambiguous.
+	uint start[ chain_max_taps + 1 ];
+	let nstarts = 0u;
+	forseq( i, 0u, n - 1 )
+		if( ir.bit( i ) && ! ir.bit( i + 1 ) && nstarts++ < info.ntaps )
+			start[ nstarts - 1 ] = i;
+	if( info.ntaps == 1 ) {
+		info.ir_len[ 0 ] = n;
+	} else if( nstarts == info.ntaps && start[ 0 ] == 0 ) {
+		start[ nstarts ] = n;
+		forseq( t, 0u, info.ntaps )
+			info.ir_len[ t ] = start[ t + 1 ] - start[ t ];
+	}
+
+	return info;
+}
+
+// the same for a chain, whose model is updated to have the instructions of
+// its TAPs all ones (BYPASS)
+template< typename Hw >
+let discover_chain( Chain<Hw> &chain ) -> ChainInfo
+{
+	let info = discover_chain( chain.jtag );
+	forseq( t, 0u, chain.ntaps )
+		if( chain.linked[ t ] )
+			chain.ir[ t ] = ~(u64) 0 >> ( 64 - chain.taps[ t ].ir_len );
+	return info;
+}
+
+let inline print_chain( ChainInfo const &info ) -> void
+{
+	printf( "scan chain: %u TAP%s, %u IR bits\n", info.ntaps,
+			info.ntaps == 1 ? "" : "s", info.ir_total );
+	forseq( t, 0u, info.ntaps ) {
+		if( info.idcode[ t ] )
+			printf( "  %u: JTAG ID %08x", t, info.idcode[ t ] );
+		else
+			printf( "  %u: no JTAG ID", t );
+		if( info.ir_len[ t ] )
+			printf( ", IR %u bits", info.ir_len[ t ] );
+		printf( "\n" );
+	}
+}
+
+// check the TAPs of a chain currently linked against those found
+template< typename Hw >
+let check_chain( Chain<Hw> const &chain, ChainInfo const &info ) -> void
+{
+	let n = 0u;
+	let ir_total = 0u;
+	forseq( t, 0u, chain.ntaps ) {
+		if( ! chain.linked[ t ] )
+			continue;
+		let &tap = chain.taps[ t ];
+		if( n == info.ntaps )
+			die( "TAP %s missing from scan chain\n", tap.name );
+		if( ! tap.matches( info.idcode[ n ] ) )
+			die( "TAP %s not recognized (JTAG ID %08x)\n", tap.name, info.idcode[ n ] );
+		if( info.ir_len[ n ] && info.ir_len[ n ] != tap.ir_len )
+			die( "TAP %s has a %u-bit IR rather than %u\n", tap.name,
+					info.ir_len[ n ], tap.ir_len );
+		ir_total += tap.ir_len;
+		++n;
+	}
+	if( n != info.ntaps )
+		die( "%u unexpected TAPs in scan chain\n", info.ntaps - n );
+	if( ir_total != info.ir_total )
+		die( "scan chain has %u IR bits rather than %u\n", info.ir_total, ir_total );
+}
@@ -0,0 +1,56 @@
+#include "defs.h"
+#include "die.h"
+#include "hw-gpio.h"
+#include "privileged.h"
+#include "ti/subarctic/ctrl.h"
+#include "ti/subarctic/prcm.h"
+
+
+//-------------- GPIO backend ------------------------------------------------//
+
+let gpio_module( uint bank ) -> Prcm::ModIO &
+{
+	switch( bank ) {
+	case 0:  return prcm.mod_io0;
+	case 1:  return prcm.mod_io1;
+	case 2:  return prcm.mod_io2;
+	default: return prcm.mod_io3;
+	}
+}
+
+let gpio_pad( IoPin pin, Pad config ) -> void
+{
+	forseq( i, 0u, countof( pad_io_table ) ) {
+		if( pad_io_table[ i ] == pin ) {
+			privileged( ctrl.pad[ i ].value ).set( config.value );
+			return;
+		}
+	}
+	die( "gpio %u.%02u has no pad\n", pin.bank_num(), pin.bit() );
+}
+
+let Gpio::init() -> void
+{
+	for( let pin : { io_tck, io_tms, io_tdi, io_trst, io_tdo } ) {
+		let &mod = gpio_module( pin.bank_num() );
+		mod.enable();
+		wait_until( mod.ready() );
+	}
+
+	forseq( b, 0u, nbanks )
+		levels[ b ] = written[ b ] = io_ptr[ b ]->out();
+
+	// TCK and TRST low, TMS and TDI high (like a pulled-up line)
+	io_tck.drive( 0 );
+	io_trst.drive( 0 );
+	io_tms.drive( 1 );
+	io_tdi.drive( 1 );
+	for( let pin : { io_tck, io_tms, io_tdi, io_trst } ) {
+		output( pin, pin.out() );
+		written[ pin.bank_num() ] = levels[ pin.bank_num() ];
+		gpio_pad( pin, Pad::gpout() );
+	}
+
+	io_tdo.highz();
+	gpio_pad( io_tdo, Pad::gpin( Pad::pull_up ) );
+}
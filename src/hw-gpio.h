@@ -0,0 +1,118 @@
+#pragma once
+#include "defs.h"
+#include "hw-stats.h"
+#include "ti/subarctic/gpio.h"
+#include "ti/subarctic/ctrl.h"
+#include "ti/subarctic/prcm.h"
+
+
+//-------------- GPIO backend ------------------------------------------------//
+//
+// For a target wired to ordinary GPIOs:  the JTAG inputs are driven directly
+// through the GPIO banks' set/clear registers, and TDO is read from the input
+// register.  Unlike padconf this needs no syscalls and no privileged writes
+// (except once, to configure the pads), so a bit costs a few device accesses.
+//
+// Pin changes are collected per bank and written with one setclear per bank.
+// A falling edge of TCK is held back until the next rising edge (or TDO
+// sample), so the TMS/TDI setup for the next cycle goes into the same write as
+// the falling edge when they share a bank.  Since the target only samples on
+// rising edges, that leaves a whole write of hold time.
+//
+// Writes to different peripherals aren't necessarily performed in the order
+// issued, so if the pins are spread over several banks, the other banks are
+// read back before TCK's bank is written.
+
+// module of a gpio bank
+let gpio_module( uint bank ) -> Prcm::ModIO &;
+
+// configure the pad of a gpio (the control module needs privileged writes)
+let gpio_pad( IoPin pin, Pad config ) -> void;
+
+struct Gpio {
+	let static constexpr has_tdo = true;
+	let static constexpr has_rtck = false;
+
+	// how the JTAG pins are wired (here on the beaglebone headers)
+	let static constexpr io_tck  = 1.12_io;	// P8.12
+	let static constexpr io_tms  = 1.13_io;	// P8.11
+	let static constexpr io_tdi  = 1.14_io;	// P8.16
+	let static constexpr io_trst = 1.15_io;	// P8.15
+	let static constexpr io_tdo  = 1.16_io;	// P9.15
+
+	let static constexpr nbanks = countof( io_ptr );
+	let static constexpr tck_bank = io_tck.bank_num();
+
+	// banks with JTAG inputs other than TCK's
+	let static constexpr other_banks = ~( 1u << tck_bank ) & (
+			1u << io_tms.bank_num() | 1u << io_tdi.bank_num() |
+			1u << io_trst.bank_num() );
+
+	HwStats stats {};
+
+	// output levels wanted, and as last written
+	u32 levels[ nbanks ] {};
+	u32 written[ nbanks ] {};
+
+	let init() -> void;
+
+	let output( IoPin pin, bool high ) -> void {
+		if( high )
+			levels[ pin.bank_num() ] |= pin.bits();
+		else
+			levels[ pin.bank_num() ] &= ~pin.bits();
+	}
+
+	// write changes of one bank, returns whether there were any
+	let bank_write( uint b ) -> bool {
+		let changed = levels[ b ] ^ written[ b ];
+		if( ! changed )
+			return false;
+		io_ptr[ b ]->setclear( levels[ b ] & changed, ~levels[ b ] & changed );
+		written[ b ] = levels[ b ];
+		++stats.pin_writes;
+		return true;
+	}
+
+	// read a bank's input register.  it's not volatile, so make sure every
+	// read is actually performed rather than reusing an earlier one.
+	let static input( uint b ) -> u32 {
+		barrier( io_ptr[ b ]->in );
+		return io_ptr[ b ]->in;
+	}
+
+	let write() -> void {
+		forseq( b, 0u, nbanks ) {
+			if( ( other_banks >> b & 1 ) && bank_write( b ) )
+				input( b );
+		}
+		bank_write( tck_bank );
+	}
+
+	let trst( bool level ) -> void {
+		output( io_trst, level );
+		write();
+	}
+
+	let tck( bool level ) -> void {
+		stats.tck_cycles += level;
+		if( level )
+			write();  // falling edge and setup first
+		output( io_tck, level );
+		if( level )
+			bank_write( tck_bank );
+	}
+
+	let tms( bool level ) -> void {  output( io_tms, level );  }
+	let tdi( bool level ) -> void {  output( io_tdi, level );  }
+
+	let tdo() -> bool {
+		write();
+		return input( io_tdo.bank_num() ) & io_tdo.bits();
+	}
+
+	// RTCK unavailable
+	let rtck() -> bool {  return false;  }
+
+	let flush() -> void {  write();  }
+};
@@ -0,0 +1,391 @@
+#include "defs.h"
+#include "hw-sim.h"
+#include "icepick.h"
+#include "dap.h"
+#include "target-subarctic.h"
+
+
+//-------------- Simulated target config -------------------------------------//
+
+let constexpr sim_icepick_idcode   = 0x2b94402fu;
+let constexpr sim_icepick_id       = 0x41611cc0u;
+let constexpr sim_icepick_usercode = 0x00000000u;
+let constexpr sim_dap_idcode       = 0x3ba00477u;
+
+// icepick router registers
+let constexpr sim_icepick_dbgen    = 0x60u;	// bit 13: assert cortex-a8 DBGEN
+let constexpr sim_icepick_dap_port = 0x2cu;	// bit 8: select debug TAP
+
+let constexpr sim_apb_ap = 1u;			// AP number of the APB-AP
+let constexpr sim_apb_ap_idr = 0x44770002u;
+let constexpr sim_apb_rom = 0x80000003u;	// debug rom at 0x80000000, present
+
+
+//-------------- TAP controller ----------------------------------------------//
+
+let SimTarget::init() -> void
+{
+	tap_reset();
+
+	a8.prsr = 1 << 0 | 1 << 1 | 1 << 3;  // powered up, sticky powerdown/reset
+}
+
+// Test-Logic-Reset:  IRs revert to IDCODE, and the icepick drops the debug TAP
+// from the chain.
+let SimTarget::tap_reset() -> void
+{
+	state = TapState::reset;
+	icepick.ir = icepick::ir_idcode;
+	icepick.connected = false;
+	icepick.router[ sim_icepick_dap_port ] = 0;
+	dap.ir = dap::ir_idcode;
+	dap.linked = false;
+}
+
+let SimTarget::rising_edge() -> void
+{
+	++stats.tck_cycles;
+	if( dap.busy )
+		--dap.busy;
+
+	if( ! trst_level )
+		return;
+
+	switch( state ) {
+	case TapState::ir_capture:	capture_ir();	break;
+	case TapState::dr_capture:	capture_dr();	break;
+	case TapState::ir_shift:
+	case TapState::dr_shift:	shift();	break;
+	default:					break;
+	}
+
+	let prev = state;
+	state = tap_next( state, tms_level );
+	if( state == prev && state != TapState::idle )
+		return;
+
+	switch( state ) {
+	case TapState::reset:		tap_reset();	break;
+	case TapState::ir_update:	update_ir();	break;
+	case TapState::dr_update:	update_dr();	break;
+	case TapState::idle:		run_idle();	break;
+	default:					break;
+	}
+}
+
+// TDO changes on the falling edge of TCK
+let SimTarget::falling_edge() -> void
+{
+	if( state != TapState::ir_shift && state != TapState::dr_shift )
+		return;
+	tdo_level = ( dap.linked ? dap.sr.value : icepick.sr.value ) & 1;
+}
+
+let SimTarget::capture_ir() -> void
+{
+	icepick.sr.load( icepick::ir_len, 0b000001 );
+	dap.sr.load( dap::ir_len, 0b0001 );
+}
+
+let SimTarget::capture_dr() -> void
+{
+	icepick_capture();
+	if( dap.linked )
+		dap_capture();
+}
+
+let SimTarget::shift() -> void
+{
+	let out = icepick.sr.shift( tdi_level );
+	if( dap.linked )
+		dap.sr.shift( out );
+}
+
+let SimTarget::update_ir() -> void
+{
+	icepick.ir = (uint) icepick.sr.value;
+	if( dap.linked )
+		dap.ir = (uint) dap.sr.value;
+}
+
+let SimTarget::update_dr() -> void
+{
+	icepick_update();
+	if( dap.linked )
+		dap_update();
+}
+
+// changes to the chain take effect in Run-Test/Idle
+let SimTarget::run_idle() -> void
+{
+	if( icepick.router[ sim_icepick_dap_port ] & 1 << 8 )
+		dap.linked = true;
+}
+
+
+//-------------- ICEPick -----------------------------------------------------//
+
+let SimTarget::icepick_capture() -> void
+{
+	let &sr = icepick.sr;
+	switch( icepick.ir ) {
+	case icepick::ir_idcode:	sr.load( 32, sim_icepick_idcode );	return;
+	case icepick::ir_icepickid:	sr.load( 32, sim_icepick_id );		return;
+	case icepick::ir_usercode:	sr.load( 32, sim_icepick_usercode );	return;
+	case icepick::ir_pub_connect:
+		sr.load( 8, icepick.connected ? 0b1001 : 0 );
+		return;
+	case icepick::ir_router:
+		if( icepick.connected ) {
+			let reg = icepick.router_last;
+			sr.load( 32, reg << 24 | icepick.router[ reg ] );
+			return;
+		}
+		break;
+	}
+	sr.load( 1, 0 );  // bypass
+}
+
+let SimTarget::icepick_update() -> void
+{
+	let x = (u32) icepick.sr.value;
+	switch( icepick.ir ) {
+	case icepick::ir_pub_connect:
+		if( x >> 7 & 1 )
+			icepick.connected = ( x & 0xf ) == 0b1001;
+		return;
+	case icepick::ir_router:
+		if( ! icepick.connected )
+			return;
+		icepick.router_last = x >> 24 & 0x7f;
+		if( x >> 31 )
+			icepick.router[ icepick.router_last ] = x & 0xffffff;
+		return;
+	}
+}
+
+
+//-------------- JTAG-DP -----------------------------------------------------//
+//
+// The ack captured for a DPACC/APACC scan is WAIT while the previous AP access
+// is still in progress, in which case the op shifted in by that scan is
+// ignored (and with ORUNDETECT set, STICKYORUN gets set).  While STICKYORUN or
+// STICKYERR is set, AP accesses are ignored.
+
+let SimTarget::dap_capture() -> void
+{
+	let &sr = dap.sr;
+	switch( dap.ir ) {
+	case dap::ir_idcode:
+		sr.load( 32, sim_dap_idcode );
+		return;
+	case dap::ir_abort:
+	case dap::ir_dpacc:
+	case dap::ir_apacc:
+		dap.wait = dap.busy != 0;
+		sr.load( 35, (u64) dap.rdata << 3 |
+				( dap.wait ? dap::ack_wait : dap::ack_ok_fault ) );
+		return;
+	}
+	sr.load( 1, 0 );  // bypass
+}
+
+let SimTarget::dap_update() -> void
+{
+	let x = dap.sr.value;
+	let read = (bool)( x & 1 );
+	let a = (uint)( x >> 1 & 3 );
+	let data = (u32)( x >> 3 );
+
+	switch( dap.ir ) {
+	case dap::ir_abort:
+		if( data & 1 )
+			dap.busy = 0;
+		return;
+	case dap::ir_dpacc:
+	case dap::ir_apacc:
+		break;
+	default:
+		return;
+	}
+
+	if( dap.wait ) {
+		if( dap.ctrl & dap::ctrl_orundetect )
+			dap.ctrl |= dap::ctrl_stickyorun;
+		return;
+	}
+
+	if( dap.ir == dap::ir_dpacc )
+		dp_access( read, a, data );
+	else
+		ap_access( read, a, data );
+}
+
+let SimTarget::dp_access( bool read, uint a, u32 data ) -> void
+{
+	switch( a ) {
+	case 1:  // CTRL/STAT
+		if( read ) {
+			dap.rdata = dap.ctrl;
+			return;
+		}
+		dap.ctrl &= ~( data & dap::ctrl_sticky );
+		dap.ctrl &= dap::ctrl_sticky;
+		dap.ctrl |= data & ( dap::ctrl_orundetect |
+				dap::ctrl_cdbgpwrupreq | dap::ctrl_csyspwrupreq );
+		// power comes up instantly
+		if( dap.ctrl & dap::ctrl_cdbgpwrupreq )
+			dap.ctrl |= dap::ctrl_cdbgpwrupack;
+		if( dap.ctrl & dap::ctrl_csyspwrupreq )
+			dap.ctrl |= dap::ctrl_csyspwrupack;
+		return;
+	case 2:  // SELECT
+		if( read )
+			dap.rdata = dap.select;
+		else
+			dap.select = data;
+		return;
+	case 3:  // RDBUFF:  leaves the previous read result in place
+		return;
+	}
+	if( read )
+		dap.rdata = 0;
+}
+
+let SimTarget::ap_access( bool read, uint a, u32 data ) -> void
+{
+	if( dap.ctrl & ( dap::ctrl_stickyorun | dap::ctrl_stickyerr ) )
+		return;
+
+	let fail = [this]() {
+		dap.ctrl |= dap::ctrl_stickyerr;
+	};
+
+	if( ! ( dap.ctrl & dap::ctrl_cdbgpwrupack ) )
+		return fail();
+
+	if( dap.select >> 24 != sim_apb_ap ) {
+		// nothing there
+		if( read )
+			dap.rdata = 0;
+		return;
+	}
+
+	if( ap_latency_after )
+		--ap_latency_after;
+	else
+		dap.busy = ap_latency;
+
+	let reg = ( dap.select & 0xf0 ) | a << 2;
+	u32 *target = NULL;
+	switch( reg ) {
+	case 0x00:  // CSW
+		if( read )
+			dap.rdata = dap.csw | 1 << 6;  // DeviceEn
+		else
+			dap.csw = data & ( 0xff000000 | dap::csw_inc_mask | 7 );
+		return;
+	case 0x04:  // TAR
+		target = &dap.tar;
+		break;
+	case 0x0c:  // DRW
+	case 0x10: case 0x14: case 0x18: case 0x1c:  // BD0-BD3
+	{
+		let drw = reg == 0x0c;
+		let addr = drw ? dap.tar : ( dap.tar & ~0xf ) | ( reg & 0xf );
+		let ok = read ? apb_read( addr, dap.rdata ) : apb_write( addr, data );
+		if( ! ok )
+			return fail();
+		if( drw && ( dap.csw & dap::csw_inc_mask ) == dap::csw_inc_single ) {
+			// no carry beyond the auto-increment range
+			let inc = dap.tar + ( 1 << ( dap.csw & 7 ) );
+			dap.tar = ( dap.tar & -dap::tar_inc_range ) |
+				( inc & ( dap::tar_inc_range - 1 ) );
+		}
+		return;
+	}
+	case 0xf8:  // BASE
+		if( read )
+			dap.rdata = sim_apb_rom;
+		return;
+	case 0xfc:  // IDR
+		if( read )
+			dap.rdata = sim_apb_ap_idr;
+		return;
+	}
+
+	if( ! target ) {
+		if( read )
+			dap.rdata = 0;
+		return;
+	}
+	if( read )
+		dap.rdata = *target;
+	else
+		*target = data;
+}
+
+
+//-------------- Cortex-A8 debug registers -----------------------------------//
+
+let SimTarget::apb_read( u32 addr, u32 &data ) -> bool
+{
+	if( ( addr & -0x1000 ) != a8_debug || addr & 3 )
+		return false;
+
+	let reg = addr & 0xfff;
+	switch( reg ) {
+	case 0x000:  // DIDR
+		data = 0x15141013;
+		return true;
+	case 0x080:  // DTRRX
+		data = a8.dtrrx;
+		return true;
+	case 0x088:  // DSCR
+		data = a8.dscr;
+		return true;
+	case 0x08c:  // DTRTX
+		data = a8.dtrtx;
+		a8.dscr &= ~( 1u << 29 );
+		return true;
+	case 0x314:  // PRSR, reading clears the sticky bits
+		data = a8.prsr;
+		a8.prsr &= ~( 1u << 1 | 1u << 3 );
+		return true;
+	case 0xfb8: {  // AUTHSTATUS
+		let dbgen = icepick.router[ sim_icepick_dbgen ] >> 13 & 1;
+		// non-secure implemented and enabled if DBGEN, secure disabled
+		data = ( dbgen ? 0b11'11 : 0b10'10 ) | 0b10'10 << 4;
+		return true;
+	}
+	}
+	if( reg >= 0x100 && reg < 0x300 ) {
+		data = a8.bkwt[ ( reg - 0x100 ) / 4 % countof( a8.bkwt ) ];
+		return true;
+	}
+	data = 0;  // RAZ
+	return true;
+}
+
+let SimTarget::apb_write( u32 addr, u32 data ) -> bool
+{
+	if( ( addr & -0x1000 ) != a8_debug || addr & 3 )
+		return false;
+
+	let reg = addr & 0xfff;
+	switch( reg ) {
+	case 0x080:  // DTRRX
+		a8.dtrrx = data;
+		a8.dscr |= 1 << 30;
+		return true;
+	}
+	if( reg >= 0x100 && reg < 0x300 )
+		a8.bkwt[ ( reg - 0x100 ) / 4 % countof( a8.bkwt ) ] = data;
+	return true;  // WI
+}
+
+let SimTarget::dbg_rx() -> u32
+{
+	a8.dscr &= ~( 1u << 30 );
+	return a8.dtrrx;
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include "defs.h"
+#include "tap.h"
+#include "hw-stats.h"
+#include <limits.h>
+
+
+//-------------- Simulated target --------------------------------------------//
+//
+// Software model of the AM335x debug logic as seen through the JTAG pins, so
+// that everything above the pins can run without hardware (e.g. on a PC):
+//
+//	- a TAP controller shared by all TAPs in the chain
+//	- an ICEPick, with the public connect and the router registers
+//	- an ARM JTAG-DP, linked into the chain by the icepick (TDI -> icepick
+//	  -> dap -> TDO), with an APB-AP
+//	- the Cortex-A8 debug registers on the debug APB
+//
+// Only what jbang uses is modelled in any detail.  AP accesses can be made to
+// take a number of TCK cycles (ap_latency) to provoke WAIT responses, also from
+// a given access on (ap_latency_after), as if the bus got busy all of a sudden.
+//
+// Apart from simulating, it keeps count of TCK cycles and pin writes, as well
+// as the syscalls the padconf backend would need for the same pin activity
+// (pin writes batched until TDO is sampled), so that throughput can be
+// measured deterministically.
+
+// shift register of a TAP
+struct SimShift {
+	u64 value;
+	uint len;
+
+	let load( uint n, u64 x ) -> void {  len = n;  value = x;  }
+
+	let shift( bool in ) -> bool {
+		let out = (bool)( value & 1 );
+		value = value >> 1 | (u64) in << ( len - 1 );
+		return out;
+	}
+};
+
+struct SimIcepick {
+	uint ir;
+	SimShift sr;
+	bool connected;
+	u32 router[ 128 ];
+	uint router_last;	// register last accessed
+};
+
+struct SimDap {
+	uint ir;
+	SimShift sr;
+	bool linked;
+	bool wait;		// WAIT captured, ignore the op shifted in
+	u32 rdata;		// read result returned by next capture
+	u32 ctrl;
+	u32 select;
+	u32 csw;
+	u32 tar;
+	uint busy;		// TCK cycles until AP access completes
+};
+
+struct SimA8 {
+	u32 dtrrx;
+	u32 dtrtx;
+	u32 dscr;
+	u32 prsr;
+	u32 bkwt[ 128 ];	// breakpoint/watchpoint value/control regs
+};
+
+struct SimTarget {
+	let static constexpr has_tdo = true;
+	let static constexpr has_rtck = false;
+
+	HwStats stats {};
+
+	// TCK cycles an AP access takes, once ap_latency_after more are done
+	uint ap_latency = 0;
+	uint ap_latency_after = 0;
+
+	bool trst_level = false;
+	bool tck_level = false;
+	bool tms_level = false;
+	bool tdi_level = false;
+	bool tdo_level = false;
+
+	uint pending = 0;	// pin writes not yet flushed
+
+	TapState state = TapState::reset;
+	SimIcepick icepick {};
+	SimDap dap {};
+	SimA8 a8 {};
+
+	let init() -> void;
+
+	// pin writes are counted like the padconf backend does them:  writes
+	// that don't change the pin are skipped, the others are batched up to
+	// IOV_MAX per syscall.
+	let write( bool &pin, bool level ) -> void {
+		if( pin == level )
+			return;
+		pin = level;
+		if( pending == IOV_MAX )
+			flush();
+		++pending;
+		++stats.pin_writes;
+	}
+
+	let trst( bool level ) -> void {
+		write( trst_level, level );
+		if( ! level )
+			tap_reset();
+	}
+
+	let tck( bool level ) -> void {
+		let prev = tck_level;
+		write( tck_level, level );
+		if( level && ! prev )
+			rising_edge();
+		else if( ! level && prev )
+			falling_edge();
+	}
+
+	let tms( bool level ) -> void {  write( tms_level, level );  }
+	let tdi( bool level ) -> void {  write( tdi_level, level );  }
+
+	let tdo() -> bool {
+		flush();
+		return tdo_level;
+	}
+
+	let rtck() -> bool {  return false;  }
+
+	let flush() -> void {
+		if( pending )
+			++stats.syscalls;
+		pending = 0;
+	}
+
+	// core side of the debug communication channel
+	let dbg_rx() -> u32;
+
+	// the model
+	let tap_reset() -> void;
+	let rising_edge() -> void;
+	let falling_edge() -> void;
+
+	let capture_ir() -> void;
+	let capture_dr() -> void;
+	let shift() -> void;
+	let update_ir() -> void;
+	let update_dr() -> void;
+	let run_idle() -> void;
+
+	let icepick_capture() -> void;
+	let icepick_update() -> void;
+
+	let dap_capture() -> void;
+	let dap_update() -> void;
+	let dp_access( bool read, uint a, u32 data ) -> void;
+	let ap_access( bool read, uint a, u32 data ) -> void;
+
+	let apb_read( u32 addr, u32 &data ) -> bool;
+	let apb_write( u32 addr, u32 data ) -> bool;
+};
@@ -0,0 +1,10 @@
+#pragma once
+#include "defs.h"
+
+// Counters kept by JTAG backends, to measure what a workload costs in terms
+// that don't depend on the speed of the machine.
+struct HwStats {
+	u64 tck_cycles;		// rising edges of TCK
+	u64 pin_writes;		// writes to control JTAG inputs
+	u64 syscalls;		// performed (or, if simulated, needed) for them
+};
@@ -1,61 +1,291 @@
 #include "defs.h"
 #include "hw-subarctic.h"
-#include "privileged.h"
+#include "target-subarctic.h"
 #include "ti/subarctic/prcm.h"
-#include "ti/subarctic/ctrl.h"
-#include "ti/subarctic/gpio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/utsname.h>
+#include <initializer_list>
 
 
-//-------------- Pad configuration helper ------------------------------------//
-//
-// Uses privileged assignment to perform pad configuration, since the control
-// module (on centaurus/subarctic/aegis) ignores unprivileged writes.
+//-------------- Padconf backend ---------------------------------------------//
+
+let Padconf::writer_parse( char const *name, PrivilegedEngine &engine ) -> bool
+{
+	for( let e : { PrivilegedEngine::vm_readv, PrivilegedEngine::uring,
+			PrivilegedEngine::uring_sqpoll, PrivilegedEngine::dev_mem } ) {
+		if( ! strcmp( name, writer_name( e ) ) ) {
+			engine = e;
+			return true;
+		}
+	}
+	return false;
+}
+
+let Padconf::writer_env() -> PrivilegedEngine
+{
+	let name = getenv( "JBANG_WRITER" );
+	let engine = PrivilegedEngine::vm_readv;
+	if( name && ! writer_parse( name, engine ) )
+		die( "JBANG_WRITER: unknown writer \"%s\"\n", name );
+	return engine;
+}
 
-template< typename ...Args >
-let static padconf( uint pin, Args ...args )
+let Padconf::writer_name( PrivilegedEngine engine ) -> char const *
 {
-	privileged( ctrl.pad[ pin ] ) = Pad { args... };
+	switch( engine ) {
+	case PrivilegedEngine::vm_readv:	return "vm_readv";
+	case PrivilegedEngine::uring:		return "uring";
+	case PrivilegedEngine::uring_sqpoll:	return "uring-sqpoll";
+	case PrivilegedEngine::dev_mem:		return "dev_mem";
+	}
+	return "?";
 }
 
+// set up the writer, returns false if unavailable
+let Padconf::use_writer( PrivilegedEngine engine, uint batch ) -> bool
+{
+	let ok = false;
+	switch( engine ) {
+	case PrivilegedEngine::vm_readv:
+		pad_writes.select( engine );
+		ok = true;
+		break;
+	case PrivilegedEngine::uring:
+	case PrivilegedEngine::uring_sqpoll:
+		ok = pad_writes.use_uring( engine == PrivilegedEngine::uring_sqpoll );
+		break;
+	case PrivilegedEngine::dev_mem:
+		ok = pad_writes.use_dev_mem( ctrl.pad, sizeof ctrl.pad,
+				ctrl_phys + ( (char *) ctrl.pad - (char *) &ctrl ) );
+		break;
+	}
+	if( ok )
+		pad_writes.set_limit( batch );
+	return ok;
+}
 
-//-------------- JTAG pin i/o ------------------------------------------------//
 
-// JTAG inputs controlled by toggling receiver-enable (pins must be pulled high
-// externally or left floating to allow internal pull-up to work).
+//-------------- Writer autotuning -------------------------------------------//
 //
-let static sim_input( uint pin, bool level )
+// The fastest way to do the pad writes differs between kernels, so unless a
+// writer was chosen explicitly, init() times each available writer with a
+// range of batch sizes (writes per syscall, or per io_uring op) on a short
+// fixed waveform:  a TAP reset and IDCODE read, done directly on the pins.
+// Only configurations that read back the expected IDCODE through TDO qualify.
+//
+// The result is cached in a file (JBANG_TUNE_CACHE, by default below) along
+// with the kernel it applies to, so later runs on that kernel just check the
+// cached configuration with one IDCODE read.  SQPOLL isn't considered, since
+// its polling thread keeps a cpu busy.
+
+let static constexpr tune_cache_default = "/var/cache/jbang-writer";
+
+let static now() -> double
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+let static tune_cache_path() -> char const *
+{
+	let path = getenv( "JBANG_TUNE_CACHE" );
+	return path ? path : tune_cache_default;
+}
+
+// reset the TAP and read the IDCODE, which reset selects (0 if no TDO)
+let Padconf::read_idcode() -> u32
+{
+	let clock = [this]( bool tms_level ) {
+		tms( tms_level );
+		tck( 1 );
+		tck( 0 );
+	};
+
+	trst( 1 );
+	tck( 0 );
+	tdi( 1 );
+	forseq( i, 0u, 5u )
+		clock( 1 );		// -> reset
+	for( let tms_level : { 0, 1, 0, 0 } )
+		clock( tms_level );	// -> idle, select-dr, capture-dr, shift-dr
+
+	u32 idcode = 0;
+	forseq( i, 0u, 32u ) {
+		idcode |= (u32) tdo() << i;
+		clock( i == 31 );	// last bit -> exit1-dr
+	}
+	clock( 1 );			// -> update-dr
+	clock( 0 );			// -> idle
+	flush();
+	return idcode;
+}
+
+let Padconf::idcode_ok() -> bool
 {
-	padconf( pin, 0u, Pad::pull_up, level ? Pad::rx_en : Pad::rx_dis );
+	let idcode = read_idcode();
+	return ! has_tdo || ( idcode & idcode_mask ) == idcode_match;
 }
 
-// JTAG inputs controlled via padconf
-let trst( bool level ) -> void {  sim_input( 120, level );  }
-let tck(  bool level ) -> void {  sim_input( 119, level );  }
-let tms(  bool level ) -> void {  sim_input( 116, level );  }
-let tdi(  bool level ) -> void {  sim_input( 117, level );  }
+let static kernel_id( utsname &uts ) -> bool
+{
+	return uname( &uts ) == 0;
+}
+
+let Padconf::tune_load( PrivilegedEngine &engine, uint &batch ) -> bool
+{
+	utsname uts;
+	if( ! kernel_id( uts ) )
+		return false;
+	let f = fopen( tune_cache_path(), "r" );
+	if( ! f )
+		return false;
+
+	char release[ sizeof uts.release + 1 ];
+	char version[ sizeof uts.version + 1 ];
+	char name[ 32 ];
+	let ok = fgets( release, sizeof release, f ) &&
+		fgets( version, sizeof version, f ) &&
+		fscanf( f, "%31s %u", name, &batch ) == 2;
+	fclose( f );
+
+	release[ strcspn( release, "\n" ) ] = 0;
+	version[ strcspn( version, "\n" ) ] = 0;
+	return ok && ! strcmp( release, uts.release ) &&
+		! strcmp( version, uts.version ) && writer_parse( name, engine );
+}
 
-// JTAG output (TDO) monitored via gpio
-let tdo() -> bool {
-	return has_tdo && (3.07_io).in();
+let Padconf::tune_save() -> void
+{
+	utsname uts;
+	if( ! kernel_id( uts ) )
+		return;
+	let path = tune_cache_path();
+	let f = fopen( path, "w" );
+	if( ! f ) {
+		fprintf( stderr, "%s: %m (writer not cached)\n", path );
+		return;
+	}
+	fprintf( f, "%s\n%s\n%s %u\n", uts.release, uts.version,
+			writer_name( writer ), writer_batch );
+	fclose( f );
 }
 
-// I connected TDO to the nearby EMU0 pin, reconfigure it to gpio 3.07
-let static tdo_init()
+let Padconf::tune_writer() -> void
 {
-	padconf( 121, Pad::in( 7, Pad::pull_up ) );
+	let engine = PrivilegedEngine::vm_readv;
+	let batch = 0u;
+	if( tune_load( engine, batch ) && use_writer( engine, batch ) && idcode_ok() ) {
+		writer = engine;
+		writer_batch = batch;
+		return;
+	}
+
+	let best_cost = HUGE_VAL;
+	for( let e : { PrivilegedEngine::vm_readv, PrivilegedEngine::uring,
+			PrivilegedEngine::dev_mem } ) {
+		for( let b : { 1u, 16u, 64u, (uint) IOV_MAX } ) {
+			if( ! use_writer( e, b ) )
+				break;
+			let cost = HUGE_VAL;
+			let ok = true;
+			forseq( i, 0u, 4u ) {
+				let t0 = now();
+				ok = ok && idcode_ok();
+				cost = min( cost, now() - t0 );
+			}
+			if( ok && cost < best_cost ) {
+				writer = e;
+				writer_batch = b;
+				best_cost = cost;
+			}
+		}
+	}
 
-	prcm.mod_io3.enable();
-	wait_until( prcm.mod_io3.ready() );
+	if( best_cost == HUGE_VAL ) {
+		// leave it to the caller to find out what's wrong
+		fprintf( stderr, "no writer passed the IDCODE check\n" );
+		use_writer( PrivilegedEngine::vm_readv, IOV_MAX );
+		writer = PrivilegedEngine::vm_readv;
+		writer_batch = IOV_MAX;
+		return;
+	}
+
+	use_writer( writer, writer_batch );
+	tune_save();
 }
 
-// RTCK unavailable
-let rtck() -> bool {  return false;  }
 
-let hw_init() -> void
+//-------------- Padconf init ------------------------------------------------//
+
+let Padconf::init() -> void
 {
+	forseq( i, 0u, pad_window_size )
+		pad_shadow[ i ] = pad( pad_window + i );
+	pad_shadow_valid = true;
+
+	if( ! writer_auto && ! use_writer( writer, writer_batch ) ) {
+		fprintf( stderr, "%s unavailable, using vm_readv\n", writer_name( writer ) );
+		writer = PrivilegedEngine::vm_readv;
+		use_writer( writer, writer_batch );
+	}
+
 	prcm.mod_dbgss.enable();
 	wait_until( prcm.mod_dbgss.ready() );
 
+	if( has_tdo ) {
+		padconf( pad_tdo, Pad::in( 7, Pad::pull_up ) );
+		flush();
+
+		prcm.mod_io3.enable();
+		wait_until( prcm.mod_io3.ready() );
+	}
+
+	// tuning is done with individual pad writes, the window writes are
+	// then enabled if the writer chosen passes the selftest
+	if( writer_auto )
+		tune_writer();
+
 	if( has_tdo )
-		tdo_init();
+		window_writes = window_selftest();
+}
+
+// Window writes need the kernel to copy with 32-bit stores in ascending order,
+// which depends on the writer, so this tests the one in use.  Check the order
+// using the GPIO clear and set registers, which are adjacent in that order:
+// copying the TDO pin's bit to both leaves its output latch set only if set was
+// stored last.  (The pin is an input, so its latch is inert.)  Then check that
+// a window write reads back as written.
+let Padconf::window_selftest() -> bool
+{
+	let &io = tdo_io.bank();
+	u32 const bits[] = { tdo_io.bits(), tdo_io.bits() };
+
+	// /dev/mem only covers the pads, so point it at the GPIO bank meanwhile
+	if( writer == PrivilegedEngine::dev_mem &&
+			! pad_writes.use_dev_mem( &io, sizeof io, tdo_io_phys ) )
+		return false;
+
+	flush();
+	tdo_io.clear();
+	pad_writes.write( (u32 *) &io._clear, bits, 2 );
+	pad_writes.flush();
+	let ordered = tdo_io.out();
+	tdo_io.clear();
+	if( ! use_writer( writer, writer_batch ) || ! ordered )
+		return false;
+
+	flush();
+	pad_writes.write( &ctrl.pad[ pad_window ].value, pad_shadow.data(),
+			pad_window_size );
+	flush_writes();
+	forseq( i, 0u, pad_window_size )
+		if( privileged( ctrl.pad[ pad_window + i ].value ) != pad_shadow[ i ] )
+			return false;
+
+	return true;
 }
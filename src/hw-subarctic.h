@@ -1,36 +1,183 @@
 #pragma once
 #include "defs.h"
+#include "privileged.h"
+#include "hw-stats.h"
+#include "ti/subarctic/ctrl.h"
+#include "ti/subarctic/gpio.h"
+#include <stdlib.h>
 
 
-let hw_init() -> void;
+//-------------- Padconf backend ---------------------------------------------//
+//
+// JTAG inputs are controlled by toggling the receiver-enable of their pads
+// (pins must be pulled high externally or left floating to allow the internal
+// pull-up to work), which makes the debug logic see the level change.
+//
+// Uses privileged writes to perform pad configuration, since the control
+// module (on centaurus/subarctic/aegis) ignores unprivileged writes.
+//
+// Writes are batched, so that a whole run of them costs only one syscall.  The
+// batch is flushed whenever an input needs to be sampled.
+//
+// The JTAG pads are shadowed:  writes that wouldn't change a pad are dropped
+// (e.g. TMS during a run of idle cycles, or TDI while shifting constant data),
+// and reads of their values don't need a syscall.  The shadow is loaded by
+// init(), after which these pads must not be changed by anyone else.
+//
+// The privileged writes are done by process_vm_readv(), io_uring or /dev/mem,
+// see privileged.h.  Which one can be set by the JBANG_WRITER environment
+// variable ("vm_readv", "uring", "uring-sqpoll" or "dev_mem"), or before
+// init().  If it turns out to be unavailable, init() falls back to
+// process_vm_readv.  Otherwise init() picks the fastest writer for this
+// kernel, see "Writer autotuning" in hw-subarctic.cc.
 
+struct Padconf {
+	let static constexpr has_tdo = true;
+	let static constexpr has_rtck = false;
 
-//-------------- JTAG pin i/o ------------------------------------------------//
+	// pads of the JTAG inputs
+	let static constexpr pad_tms  = 116u;
+	let static constexpr pad_tdi  = 117u;
+	let static constexpr pad_tck  = 119u;
+	let static constexpr pad_trst = 120u;
 
-// control JTAG inputs
-let trst( bool out ) -> void;
-let tck(  bool out ) -> void;
-let tms(  bool out ) -> void;
-let tdi(  bool out ) -> void;
+	// I connected TDO to the nearby EMU0 pin, reconfigured as gpio 3.07
+	let static constexpr pad_tdo  = 121u;
+	let static constexpr tdo_io   = 3.07_io;
 
-// monitor JTAG output
-let tdo() -> bool;
-let rtck() -> bool;
+	// the pads shadowed, which includes all JTAG inputs (and pad 118, TDO,
+	// which is left alone)
+	let static constexpr pad_window = pad_tms;
+	let static constexpr pad_window_size = pad_trst + 1 - pad_window;
 
-let constexpr has_tdo = true;
-let constexpr has_rtck = false;
+	let static constexpr pad_write_segments = 8u;
 
+	PrivilegedBatch< u32, IOV_MAX, pad_write_segments > pad_writes;
+	HwStats stats {};
 
-//-------------- Debug hw config ---------------------------------------------//
+	// physical address of the control module, for writes via /dev/mem
+	let static constexpr ctrl_phys = 0x44e'10'000u;
 
-constexpr u32 idcode_mask  = 0x0'ffff'fff;
-constexpr u32 idcode_match = 0x0'b944'02f;
+	// and of the GPIO bank of TDO (io3), for the window write selftest
+	let static constexpr tdo_io_phys = 0x481'ae'000u;
 
-// initialization of icepick registers
-constexpr u32 icepick_init_regs[] = {
-	0x60'002000,  // assert cortex-a8 DBGEN
-	0x2c'002100,  // link DAP into chain (takes effect at run)
-};
+	PrivilegedEngine writer = writer_env();
+	uint writer_batch = IOV_MAX;	// writes per syscall (or io_uring op)
+	bool writer_auto = ! getenv( "JBANG_WRITER" );
+
+	let static writer_env() -> PrivilegedEngine;
+	let static writer_parse( char const *name, PrivilegedEngine &engine ) -> bool;
+	let static writer_name( PrivilegedEngine engine ) -> char const *;
+	let use_writer( PrivilegedEngine engine, uint batch ) -> bool;
+
+	let read_idcode() -> u32;
+	let idcode_ok() -> bool;
+	let tune_load( PrivilegedEngine &engine, uint &batch ) -> bool;
+	let tune_save() -> void;
+	let tune_writer() -> void;
+
+	array< u32, pad_window_size > pad_shadow {};
+	bool pad_shadow_valid = false;
+
+	let init() -> void;
+	let window_selftest() -> bool;
+
+	let static shadowed( uint pin ) -> bool {
+		return pin - pad_window < pad_window_size;
+	}
+
+	// current value of a pad
+	let pad( uint pin ) -> u32 {
+		if( pad_shadow_valid && shadowed( pin ) )
+			return pad_shadow[ pin - pad_window ];
+		return privileged( ctrl.pad[ pin ].value );
+	}
+
+	template< typename ...Args >
+	let padconf( uint pin, Args ...args ) -> void {
+		let value = Pad { args... }.value;
+		if( shadowed( pin ) ) {
+			if( pad_shadow_valid && pad_shadow[ pin - pad_window ] == value )
+				return;
+			pad_shadow[ pin - pad_window ] = value;
+		}
+		if( ! pad_writes.room( 1 ) )
+			flush_writes();
+		pad_writes.write( ctrl.pad[ pin ].value, value );
+		++stats.pin_writes;
+	}
+
+	// Window writes.  Since the JTAG input pads all lie within the window, a
+	// change of any of them can be done by copying the whole window from
+	// the shadow, which also lets changes of several pads share one copy.
+	// TMS/TDI changes are held back until the TCK edge they're set up for,
+	// so that each TCK edge costs just one iovec.
+	//
+	// This relies on the copy being done with 32-bit stores in ascending
+	// order:  TMS and TDI (116, 117) are then stored before TCK (119), which
+	// is the order a rising edge needs.  For a falling edge it doesn't
+	// matter, the previous rising edge was an earlier copy so hold time is
+	// not an issue.  init() checks the copy behaves with the writer it ends
+	// up using, and otherwise pads are written individually.
 
-// address of cortex-a8 debug regs on debug APB
-constexpr u32 a8_debug = 0x800'01'000;
+	bool window_writes = false;
+	bool window_dirty = false;	// shadow has changes not yet queued
+
+	let window_queue() -> void {
+		if( ! window_dirty )
+			return;
+		if( ! pad_writes.room( pad_window_size ) )
+			flush_writes();
+		pad_writes.write( &ctrl.pad[ pad_window ].value, pad_shadow.data(),
+				pad_window_size );
+		++stats.pin_writes;
+		window_dirty = false;
+	}
+
+	let static constexpr input_pad( bool level ) -> u32 {
+		return Pad { 0, Pad::pull_up, level ? Pad::rx_en : Pad::rx_dis }.value;
+	}
+
+	let sim_input( uint pin, bool level ) -> void {
+		if( ! window_writes ) {
+			padconf( pin, 0u, Pad::pull_up, level ? Pad::rx_en : Pad::rx_dis );
+			return;
+		}
+		let &shadow = pad_shadow[ pin - pad_window ];
+		if( shadow == input_pad( level ) )
+			return;
+		shadow = input_pad( level );
+		window_dirty = true;
+		if( pin == pad_tck || pin == pad_trst )
+			window_queue();
+	}
+
+	let trst( bool level ) -> void {  sim_input( pad_trst, level );  }
+	let tck(  bool level ) -> void {
+		stats.tck_cycles += level;
+		sim_input( pad_tck, level );
+	}
+	let tms(  bool level ) -> void {  sim_input( pad_tms,  level );  }
+	let tdi(  bool level ) -> void {  sim_input( pad_tdi,  level );  }
+
+	// TDO only depends on what has been clocked in, so TMS/TDI changes that
+	// are being held back don't need to be written first
+	let tdo() -> bool {
+		if( ! has_tdo )
+			return false;
+		flush_writes();
+		return tdo_io.in();
+	}
+
+	// RTCK unavailable
+	let rtck() -> bool {  return false;  }
+
+	let flush_writes() -> void {
+		stats.syscalls += pad_writes.flush();
+	}
+
+	let flush() -> void {
+		window_queue();
+		flush_writes();
+	}
+};
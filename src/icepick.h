@@ -1,4 +1,9 @@
+#pragma once
 #include "defs.h"
+#include "die.h"
+#include "jtag.h"
+#include "chain.h"
+#include "discover.h"
 
 namespace icepick {
 
@@ -29,4 +34,214 @@ enum {
 	ir_router	= 0b000010,  // 32-bit (7 -> 24 bit indirect rw)
 };
 
+// router registers of the secondary TAPs
+let constexpr reg_tap_first = 0x20u;
+let constexpr reg_tap_last  = 0x2fu;
+
+enum : u32 {
+	tap_select	= 1 << 8,  // link TAP into the chain
+	tap_link	= 1 << 13 | tap_select,  // as TI's init sequences do
+};
+
 } // namespace icepick
+
+
+//-------------- ICEPick-C/D -------------------------------------------------//
+
+#if 0
+template< typename Hw >
+let icepick_check( Jtag<Hw> &jtag, uint reg ) -> u32
+{
+	let x = (u32) jtag.get( jtag.capture_dr( 32, 0 ) );
+	if( ( x >> 24 ) != reg )
+		die( "icepick error" );
+	return x & 0xffffff;
+}
+
+template< typename Hw >
+let icepick_read( Jtag<Hw> &jtag, uint reg ) -> u32
+{
+	jtag.scan_dr( 32, 0 << 31 | reg << 24 );
+	return icepick_check( jtag, reg );
+}
+
+template< typename Hw >
+let icepick_write( Jtag<Hw> &jtag, uint reg, u32 data ) -> u32
+{
+	jtag.scan_dr( 32, 1 << 31 | reg << 24 | ( data & 0xffffff ) );
+	return icepick_check( jtag, reg );
+}
+
+template< typename Hw >
+let icepick_dump( Jtag<Hw> &jtag, uint reg ) -> u32
+{
+	let x = icepick_read( jtag, reg );
+	printf( "icepick [%02x]: %06x\n", reg, x );
+	return x;
+}
+#endif
+
+// connect and write the given router registers, then link in the TAPs of the
+// chain that are behind the icepick (see icepick_discover).  they're marked as
+// linked in the chain, as they will be after the next idle cycles.
+template< typename Hw, size_t nregs >
+let icepick_init( Chain<Hw> &chain, u32 const (&regs)[ nregs ] ) -> void
+{
+	let &jtag = chain.jtag;
+	let tap = chain.find( "icepick" );
+
+	u32 writes[ nregs + chain_max_taps ];
+	let nwrites = 0u;
+	forseq( i, 0u, nregs )
+		writes[ nwrites++ ] = regs[ i ];
+	forseq( t, 0u, chain.ntaps ) {
+		let reg = chain.icepick_reg[ t ];
+		if( reg == icepick_reg_unknown )
+			die( "TAP %s not found behind icepick\n", chain.taps[ t ].name );
+		if( reg )
+			writes[ nwrites++ ] = reg << 24 | icepick::tap_link;
+	}
+
+	chain.select( tap, icepick::ir_pub_connect );
+	chain.scan_dr( tap, 8, 0b1'000'1001 );
+	let connect = chain.capture_dr( tap, 8 );
+
+	chain.select( tap, icepick::ir_router );
+
+	// queue all register writes and their readbacks, then check them
+	Scan check[ nregs + chain_max_taps ];
+	forseq( i, 0u, nwrites ) {
+		chain.scan_dr( tap, 32, writes[ i ] | 1 << 31 );
+		check[ i ] = chain.capture_dr( tap, 32 );
+		if( chain.translog )
+			chain.translog->record( jtag, TransRecord { TransKind::router,
+					(u8) tap, icepick::ir_router, 1,
+					writes[ i ] | 1 << 31, 0 }, &check[ i ] );
+	}
+
+	// linking takes effect in Run-Test/Idle.  the icepick gets put in
+	// bypass by the first IR scan of the extended chain.
+	jtag.scan_idle( 16 );
+	chain.log_idle( 16 );
+
+	forseq( t, 0u, chain.ntaps )
+		if( chain.icepick_reg[ t ] )
+			chain.link( t );
+
+	if( ! Hw::has_tdo )
+		return;
+
+	if( jtag.get( connect ) != 0b1001 )
+		die( "icepick connect failed" );
+
+	forseq( i, 0u, nwrites )
+		if( jtag.get( check[ i ] ) >> 24 != writes[ i ] >> 24 )
+			die( "icepick write error" );
+}
+
+// find the secondary TAP register of each TAP of the chain behind the icepick,
+// rather than relying on the table, by linking in one secondary TAP after the
+// other and looking for a TAP of the same IDCODE and IR length showing up in
+// the chain.  since that forces the TAP active, the registers given in the
+// table are tried first, and the others only while a TAP hasn't been found
+// that way (or all of them if all is set, e.g. to find out what a board has).
+// each is restored after.  this leaves the chain reset, i.e. with none of
+// them linked.
+template< typename Hw >
+let icepick_discover( Chain<Hw> &chain, bool all = false ) -> void
+{
+	let &jtag = chain.jtag;
+	let tap = chain.find( "icepick" );
+
+	let tabled = array< bool, icepick::reg_tap_last + 1 > {};
+	forseq( t, 0u, chain.ntaps ) {
+		let reg = chain.taps[ t ].icepick_reg;
+		if( reg >= icepick::reg_tap_first && reg <= icepick::reg_tap_last )
+			tabled[ reg ] = true;
+		if( chain.icepick_reg[ t ] )
+			chain.icepick_reg[ t ] = icepick_reg_unknown;
+	}
+
+	// whether a TAP behind the icepick is yet to be found
+	let missing = [&]() {
+		forseq( t, 0u, chain.ntaps )
+			if( chain.icepick_reg[ t ] == icepick_reg_unknown )
+				return true;
+		return false;
+	};
+
+	// reset, connect and get to the router registers
+	let router = [&]() {
+		chain.init();
+		chain.select( tap, icepick::ir_pub_connect );
+		chain.scan_dr( tap, 8, 0b1'000'1001 );
+		chain.select( tap, icepick::ir_router );
+	};
+
+	// write a register, back to IDCODE before it takes effect in
+	// Run-Test/Idle
+	let write = [&]( uint reg, u32 value ) {
+		let word = 1u << 31 | reg << 24 | ( value & 0xffffff );
+		chain.scan_dr( tap, 32, word );
+		if( chain.translog )
+			chain.translog->record( jtag, TransRecord { TransKind::router,
+					(u8) tap, icepick::ir_router, 0, word, 0 } );
+		chain.select( tap, icepick::ir_idcode );
+		chain.update_ir( tap );
+		jtag.scan_idle( 16 );
+		chain.log_idle( 16 );
+	};
+
+	chain.init();
+	let base = discover_chain( chain );
+
+	// link in the secondary TAP of reg, and see which TAP that adds
+	let probe = [&]( uint reg ) {
+		router();
+		chain.scan_dr( tap, 32, reg << 24 );
+		let read = chain.capture_dr( tap, 32 );
+		if( chain.translog )
+			chain.translog->record( jtag, TransRecord { TransKind::router,
+					(u8) tap, icepick::ir_router, 1, reg << 24, 0 }, &read );
+		let saved = (u32) jtag.get( read );
+		if( saved >> 24 != reg )
+			die( "icepick read error\n" );
+
+		write( reg, icepick::tap_link );
+		let found = discover_chain( jtag );
+
+		// restore the register (after a reset, which gets the chain
+		// back to what its model has)
+		router();
+		write( reg, saved );
+
+		if( found.ntaps != base.ntaps + 1 )
+			return;
+
+		// the one that's new
+		let n = 0u;
+		while( n < base.ntaps && found.idcode[ n ] == base.idcode[ n ] )
+			++n;
+		let ir_len = found.ir_total - base.ir_total;
+
+		forseq( t, 0u, chain.ntaps ) {
+			let &desc = chain.taps[ t ];
+			if( chain.icepick_reg[ t ] == icepick_reg_unknown &&
+					desc.matches( found.idcode[ n ] ) && desc.ir_len == ir_len ) {
+				chain.icepick_reg[ t ] = reg;
+				break;
+			}
+		}
+	};
+
+	forseq( reg, icepick::reg_tap_first, icepick::reg_tap_last + 1 )
+		if( all || tabled[ reg ] )
+			probe( reg );
+
+	// a TAP not where the table has it, on a part that differs from it
+	forseq( reg, icepick::reg_tap_first, icepick::reg_tap_last + 1 )
+		if( ! all && ! tabled[ reg ] && missing() )
+			probe( reg );
+
+	chain.init();
+}
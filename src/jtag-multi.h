@@ -0,0 +1,238 @@
+#pragma once
+#include "defs.h"
+#include "die.h"
+#include "tap.h"
+#include "hw-stats.h"
+#include "hw-gpio.h"
+
+
+//-------------- Bit-parallel JTAG over one GPIO bank ------------------------//
+//
+// Drives several JTAG chains (e.g. a rack of identical boards) in lockstep from
+// a single GPIO bank:  TCK and nTRST are shared, while each chain has its own
+// TMS, TDI and TDO.  All chains go through the same TAP states, but each one
+// shifts its own data.
+//
+// Since the bank's setclear register changes any of its 32 lines at once, a TCK
+// cycle costs the same however many chains there are:  one write for the
+// falling edge along with the TMS/TDI setup of every chain, one read of the
+// input register sampling every TDO, and one write for the rising edge.
+//
+// Scans are first rendered into per-cycle set/clear words, transposing the
+// chains' data, then clocked out in one go, after which the samples are
+// transposed back into per-chain data.  Scans longer than the cycles buffer
+// are done in parts, TCK pausing in the shift state in between.  As in the
+// gpio backend, TCK is left high after the last cycle, its falling edge going
+// along with the next one.
+
+template< uint nchains >
+struct GpioChains {
+	IoPin tck;
+	IoPin trst;	// optional
+	IoPin tms[ nchains ];
+	IoPin tdi[ nchains ];
+	IoPin tdo[ nchains ];
+};
+
+let constexpr multi_max_cycles = 256u;
+
+template< uint nchains >
+struct MultiJtag {
+	// three pins per chain, plus the shared ones
+	static_assert( nchains >= 1 && nchains * 3 + 2 <= 32, "" );
+
+	using Words = array< u64, nchains >;
+
+	GpioChains< nchains > const pins;
+	HwStats stats {};
+
+	explicit MultiJtag( GpioChains< nchains > const &pins ) : pins( pins ) {}
+
+	// masks of the pins within the bank
+	u32 tck = 0;
+	u32 trst = 0;
+	u32 tms_all = 0;
+	u32 tdi_all = 0;
+	u32 tdo_all = 0;
+
+	let bank() const -> Io & {  return pins.tck.bank();  }
+
+	let init() -> void
+	{
+		let pin_mask = [this]( IoPin pin, u32 &mask ) {
+			if( ! pin.valid() )
+				return;
+			if( pin.bank_num() != pins.tck.bank_num() )
+				die( "gpio %u.%02u not in the same bank as TCK\n",
+						pin.bank_num(), pin.bit() );
+			if( ( tck | trst | tms_all | tdi_all | tdo_all ) & pin.bits() )
+				die( "gpio %u.%02u used twice\n", pin.bank_num(), pin.bit() );
+			mask |= pin.bits();
+		};
+
+		if( ! pins.tck.valid() )
+			die( "no TCK\n" );
+		pin_mask( pins.tck, tck );
+		pin_mask( pins.trst, trst );
+		forseq( c, 0u, nchains ) {
+			if( ! pins.tms[ c ].valid() || ! pins.tdi[ c ].valid() ||
+					! pins.tdo[ c ].valid() )
+				die( "chain %u not fully wired\n", c );
+			pin_mask( pins.tms[ c ], tms_all );
+			pin_mask( pins.tdi[ c ], tdi_all );
+			pin_mask( pins.tdo[ c ], tdo_all );
+		}
+
+		let &mod = gpio_module( pins.tck.bank_num() );
+		mod.enable();
+		wait_until( mod.ready() );
+
+		// TCK and TRST low, TMS and TDI high (like a pulled-up line)
+		let &io = bank();
+		io.setclear( tms_all | tdi_all, tck | trst );
+		io.drive( tck | trst | tms_all | tdi_all );
+		io.highz( tdo_all );
+
+		gpio_pad( pins.tck, Pad::gpout() );
+		if( pins.trst.valid() )
+			gpio_pad( pins.trst, Pad::gpout() );
+		forseq( c, 0u, nchains ) {
+			gpio_pad( pins.tms[ c ], Pad::gpout() );
+			gpio_pad( pins.tdi[ c ], Pad::gpout() );
+			gpio_pad( pins.tdo[ c ], Pad::gpin( Pad::pull_up ) );
+		}
+	}
+
+
+	//-------- Cycles
+
+	struct Cycle {
+		u32 set;
+		u32 clear;
+	};
+
+	array< Cycle, multi_max_cycles > cycles {};
+	array< u32, multi_max_cycles > samples {};
+	uint ncycles = 0;	// rendered but not yet clocked
+
+	// render a cycle, with TMS of all chains at the given level and TDI of
+	// those in tdi_set high, the others low
+	let cycle( bool tms, u32 tdi_set ) -> void
+	{
+		if( ncycles == multi_max_cycles )
+			clock();
+		let set = tdi_set | ( tms ? tms_all : 0 );
+		cycles[ ncycles++ ] = Cycle { set, ( tms_all | tdi_all ) & ~set };
+	}
+
+	// clock out all cycles rendered, sampling the input register before
+	// each rising edge
+	let clock() -> void
+	{
+		let &io = bank();
+		forseq( i, 0u, ncycles ) {
+			io.setclear( cycles[ i ].set, cycles[ i ].clear | tck );
+			samples[ i ] = Gpio::input( pins.tck.bank_num() );
+			io.set( tck );
+		}
+		stats.tck_cycles += ncycles;
+		stats.pin_writes += 2 * ncycles;
+		ncycles = 0;
+	}
+
+	let flush() -> void {  clock();  }
+
+
+	//-------- JTAG protocol (see jtag.h)
+
+	TapState state = TapState::reset;
+
+	let tap_goto( TapState to ) -> void
+	{
+		let path = tap_paths( state, to );
+		forseq( i, 0u, path.len )
+			cycle( path.tms >> i & 1, tdi_all );
+		state = to;
+	}
+
+	let run( uint n = 1 ) -> void
+	{
+		tap_goto( TapState::idle );
+		forseq( i, 0u, n )
+			cycle( 0, tdi_all );
+	}
+
+	// shift nbits of each chain's data through its IR/DR, leaving the TAPs
+	// in the Update state.  the data is given as ( nbits + 63 ) / 64 Words,
+	// the first holding bits 0-63 of each chain and so on, with NULL out
+	// shifting zeros.  if in is given, the data shifted out of each chain is
+	// stored there (which clocks out everything rendered).  long scans are
+	// clocked out as the cycles fill up, staying in the shift state meanwhile.
+	let xfer( TapState shift, uint nbits, Words const *out, Words *in = NULL ) -> void
+	{
+		if( nbits == 0 )
+			die( "invalid scan length (%u bits)\n", nbits );
+
+		tap_goto( shift );
+
+		for( uint done = 0; done < nbits; ) {
+			if( ncycles == multi_max_cycles )
+				clock();
+			let first = ncycles;
+			let n = min( nbits - done, multi_max_cycles - first );
+			forseq( i, done, done + n ) {
+				u32 tdi_set = 0;
+				if( out ) {
+					forseq( c, 0u, nchains )
+						tdi_set |= -(u32)( out[ i / 64 ][ c ] >> i % 64 & 1 ) &
+							pins.tdi[ c ].bits();
+				}
+				cycle( i == nbits - 1, tdi_set );
+			}
+
+			if( in ) {
+				clock();
+				forseq( c, 0u, nchains ) {
+					let bit = pins.tdo[ c ].bit();
+					forseq( i, done, done + n ) {
+						let &x = in[ i / 64 ][ c ];
+						if( i % 64 == 0 )
+							x = 0;
+						x |= (u64)( samples[ first + i - done ] >> bit & 1 ) << i % 64;
+					}
+				}
+			}
+			done += n;
+		}
+		state = tap_next( shift, true );
+		tap_goto( tap_next( state, true ) );
+	}
+
+	let reset() -> void
+	{
+		clock();
+		if( trst )
+			bank().clear( trst );
+		forseq( i, 0u, 5u )
+			cycle( 1, tdi_all );
+		clock();
+		if( trst )
+			bank().set( trst );
+		state = TapState::reset;
+	}
+
+	// reset and read the IDCODE of every chain
+	let init_chains() -> array< u32, nchains >
+	{
+		reset();
+		run( 100 );
+
+		let ids = Words {};
+		xfer( TapState::dr_shift, 32, NULL, &ids );
+
+		let res = array< u32, nchains > {};
+		forseq( c, 0u, nchains )
+			res[ c ] = (u32) ids[ c ];
+		return res;
+	}
+};
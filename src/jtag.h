@@ -0,0 +1,359 @@
+#pragma once
+#include "defs.h"
+#include "die.h"
+#include "tap.h"
+#include "bitvec.h"
+#include <stdio.h>
+#include <inttypes.h>
+
+
+//-------------- JTAG backends -----------------------------------------------//
+//
+// The JTAG engine is a template over the backend that drives the pins, so that
+// the shift loops get compiled for each backend with all the pin i/o inlined.
+// Which backend gets used is up to the program.  A backend is a struct with:
+//
+//	let static constexpr has_tdo, has_rtck	(bool)
+//	HwStats stats;				(see hw-stats.h)
+//	let init() -> void;
+//
+//	// control JTAG inputs
+//	let trst( bool ) -> void;	(also tck, tms, tdi)
+//
+//	// monitor JTAG outputs
+//	// (implies flush, the output is sampled after all preceding writes)
+//	let tdo() -> bool;
+//	let rtck() -> bool;
+//
+//	// JTAG input writes may be queued up, this makes sure they've been
+//	// performed
+//	let flush() -> void;
+
+
+//-------------- Scan handles ------------------------------------------------//
+//
+// Rather than being performed immediately, scans and idle cycles are queued up
+// and performed in one go when the queue is flushed.  This gives the layer
+// below a view of whole transactions rather than single bits, and TDO only
+// gets sampled for scans whose result was actually asked for.
+//
+// Queueing a capturing scan returns a handle which resolves to the captured
+// TDO data (or the part of it given by pos and nbits) once the queue has been
+// flushed.  Calling get() on a handle that hasn't resolved yet flushes the
+// queue.
+
+struct Scan {
+	uint seq;
+	u8 pos = 0;	// part of the data that's of interest
+	u8 nbits = 64;
+};
+
+enum class ScanType : u8 {
+	idle,
+	ir,
+	dr,
+};
+
+struct ScanOp {
+	ScanType type;
+	bool capture;
+	uint nbits;	// or number of cycles for idle
+	uint seq;	// result slot (if capture)
+	u64 out;
+};
+
+let constexpr scan_queue_size = 256u;
+let constexpr scan_results_size = 1024u;  // must be power of two
+
+let constexpr jtag_verbose = false;
+
+
+//-------------- JTAG engine -------------------------------------------------//
+
+template< typename Hw >
+struct Jtag {
+	Hw &hw;
+
+	explicit Jtag( Hw &hw ) : hw( hw ) {}
+
+
+	//-------- JTAG protocol
+	//
+	// bit-banging JTAG via padconf is so slow that we really don't need to
+	// bother inserting any explicit setup/hold time delays...
+	//
+	// Pin writes are queued by the backend and only performed when tdo()
+	// needs to sample the output (or on flush), so nothing here flushes
+	// explicitly:  the only points where the queue drains are the TDO
+	// samples in xfer().
+	//
+	// Since only rising edges of TCK matter, TMS and TDI are set up for the
+	// next cycle while TCK is low and left alone until then.
+
+	let tck_pulse() -> void
+	{
+		// <setup time for TMS/TDI>
+		hw.tck( 1 );
+		// <hold time for TMS/TDI>
+		hw.tck( 0 );
+		// <delay until output data valid>
+	}
+
+	let cmd( uint nbits, uint data ) -> void
+	{
+		forseq( i, 0u, nbits ) {
+			hw.tms( data >> i & 1 );
+			tck_pulse();
+		}
+	}
+
+	// TAP state tracking.  Every TMS sequence is derived from the state
+	// we're in and the state we want to be in, rather than being hardcoded,
+	// so that e.g. a scan following an Update-DR goes straight to Select-DR
+	// instead of taking a detour through Run-Test/Idle.
+
+	TapState state = TapState::reset;
+
+	let tap_goto( TapState to ) -> void
+	{
+		let path = tap_paths( state, to );
+		cmd( path.len, path.tms );
+		state = to;
+	}
+
+	// clock given number of cycles in Run-Test/Idle
+	let run( uint ncycles = 1 ) -> void
+	{
+		tap_goto( TapState::idle );
+		cmd( ncycles, 0 );
+		if( jtag_verbose ) printf( "run <%u>\n", ncycles );
+	}
+
+	// shift n (at most 64) bits while in a Shift state, the last one while
+	// moving on to Exit1 if last is set
+	let shift_word( uint n, u64 out, bool last, bool capture ) -> u64
+	{
+		u64 in = 0;
+		forseq( i, 0u, n ) {
+			hw.tdi( out >> i & 1 );
+			if( last && i == n - 1 )
+				hw.tms( 1 );
+			if( capture )
+				in |= (u64) hw.tdo() << i;
+			tck_pulse();
+		}
+		return in;
+	}
+
+	// shift data through the IR/DR selected by moving to a Shift state.  The
+	// last bit is shifted while moving on to Exit1, and the TAP is then left
+	// in the Update state (which is where the data takes effect).
+	//
+	// TDO is sampled before each rising edge of TCK, unless capture is false
+	// in which case no flush of pending pin writes is needed either.
+	//
+	let xfer( TapState shift, uint nbits, u64 out, bool capture = true ) -> u64
+	{
+		tap_goto( shift );
+		let in = shift_word( nbits, out, true, capture );
+		state = tap_next( shift, true );
+
+		if( jtag_verbose ) {
+			printf( "%s <%u> ", shift == TapState::ir_shift ? "ir" : "dr", nbits );
+			if( capture )
+				printf( "0x%" PRIx64 " ", in );
+			printf( "/ 0x%" PRIx64 "\n", out );
+		}
+
+		tap_goto( tap_next( state, true ) );
+		return in;
+	}
+
+	// shift a scan of any length, produced and consumed a word at a time:
+	// out( w ) gives bits 64w and up of the data to shift in, and in( w, x )
+	// is handed those shifted out in their place (all zeros unless capture
+	// is set and TDO is available).  The TAP is left in Exit1.
+	template< typename Out, typename In >
+	let shift_words( TapState shift, uint nbits, Out &&out, In &&in, bool capture ) -> void
+	{
+		if( nbits == 0 )
+			die( "invalid scan length (0 bits)\n" );
+
+		tap_goto( shift );
+		capture = capture && Hw::has_tdo;
+		for( uint pos = 0; pos < nbits; pos += 64 ) {
+			let n = min( nbits - pos, 64u );
+			in( pos / 64, shift_word( n, out( pos / 64 ), pos + n == nbits, capture ) );
+		}
+		state = tap_next( shift, true );
+
+		if( jtag_verbose )
+			printf( "%s <%u>\n", shift == TapState::ir_shift ? "ir" : "dr", nbits );
+	}
+
+	// same for a bit vector, leaving the TAP in the Update state.  the data
+	// shifted out is stored in *in, if given.
+	let xfer( TapState shift, BitVec const &out, BitVec *in = NULL ) -> void
+	{
+		if( in )
+			*in = BitVec {};
+		shift_words( shift, out.len,
+			[&]( uint w ) {  return out.words[ w ];  },
+			[&]( uint w, u64 x ) {
+				if( in )
+					in->append( min( out.len - w * 64, 64u ), x );
+			}, in != NULL );
+		tap_goto( tap_next( state, true ) );
+	}
+
+
+	//-------- Scan queue
+
+	array< ScanOp, scan_queue_size > queue {};
+	uint queued = 0;
+
+	array< u64, scan_results_size > results {};
+	uint seq = 0;	// seq of next capturing scan
+	uint done = 0;	// captures with seq below this have resolved
+
+	let scan_flush() -> void
+	{
+		forseq( i, 0u, queued ) {
+			let &op = queue[ i ];
+
+			if( op.type == ScanType::idle ) {
+				run( op.nbits );
+				continue;
+			}
+
+			let shift = op.type == ScanType::ir ? TapState::ir_shift : TapState::dr_shift;
+			let in = xfer( shift, op.nbits, op.out, op.capture && Hw::has_tdo );
+			if( op.capture )
+				results[ op.seq % scan_results_size ] = in;
+		}
+		queued = 0;
+		done = seq;
+	}
+
+	let scan_push( ScanType type, uint nbits, u64 out, bool capture ) -> Scan
+	{
+		if( type != ScanType::idle && ( nbits == 0 || nbits > 64 ) )
+			die( "invalid scan length (%u bits)\n", nbits );
+		if( queued == scan_queue_size )
+			scan_flush();
+		let s = capture ? seq++ : 0;
+		queue[ queued++ ] = ScanOp { type, capture, nbits, s, out };
+		return Scan { s };
+	}
+
+	// whether a handle has resolved, i.e. get() won't need to flush
+	let resolved( Scan scan ) const -> bool
+	{
+		return scan.seq - done >= seq - done;
+	}
+
+	// resolve a scan handle, flushing the queue if needed
+	let get( Scan scan ) -> u64
+	{
+		if( ! resolved( scan ) )
+			scan_flush();
+		if( seq - scan.seq > scan_results_size )
+			die( "stale scan handle\n" );
+		let x = results[ scan.seq % scan_results_size ] >> scan.pos;
+		return scan.nbits < 64 ? x & ( ( (u64) 1 << scan.nbits ) - 1 ) : x;
+	}
+
+	// a handle to the same result as scan, but in a fresh slot as if just
+	// captured, to keep a result around while more captures get queued
+	// than the results window holds
+	let pin( Scan scan ) -> Scan
+	{
+		let x = get( scan );
+		let s = seq++;
+		results[ s % scan_results_size ] = x;
+		if( ! queued )
+			done = seq;
+		return Scan { s, 0, scan.nbits };
+	}
+
+	// a handle that's already resolved (to whatever), for ops that were
+	// never queued
+	let dummy_scan() const -> Scan {  return Scan { seq - 1 };  }
+
+	// queue scans whose TDO data is not needed
+	let scan_ir( uint nbits, u64 out ) -> void {
+		scan_push( ScanType::ir, nbits, out, false );
+	}
+	let scan_dr( uint nbits, u64 out = 0 ) -> void {
+		scan_push( ScanType::dr, nbits, out, false );
+	}
+
+	// queue scans whose TDO data is returned (via handle)
+	let capture_ir( uint nbits, u64 out ) -> Scan {
+		return scan_push( ScanType::ir, nbits, out, true );
+	}
+	let capture_dr( uint nbits, u64 out = 0 ) -> Scan {
+		return scan_push( ScanType::dr, nbits, out, true );
+	}
+
+	// scans longer than a queue entry can hold are performed right away
+	// (after everything queued before them)
+	let scan_ir( BitVec const &out, BitVec *in = NULL ) -> void {
+		scan_flush();
+		xfer( TapState::ir_shift, out, in );
+	}
+	let scan_dr( BitVec const &out, BitVec *in = NULL ) -> void {
+		scan_flush();
+		xfer( TapState::dr_shift, out, in );
+	}
+
+	// queue cycles in Run-Test/Idle
+	let scan_idle( uint ncycles = 1 ) -> void {
+		if( ncycles )
+			scan_push( ScanType::idle, ncycles, 0, false );
+	}
+
+	// perform everything queued so far, all the way down to the pins
+	let flush() -> void
+	{
+		scan_flush();
+		hw.flush();
+	}
+
+
+	//-------- TAP reset / init
+
+	// assert or release nTRST, after everything queued.  asserting it puts
+	// the TAP in Test-Logic-Reset, so the state tracking follows.
+	let trst( bool asserted ) -> void
+	{
+		scan_flush();
+		hw.trst( ! asserted );
+		if( asserted )
+			state = TapState::reset;
+	}
+
+	let reset() -> void
+	{
+		trst( true );
+		hw.tck( 0 );
+		hw.tdi( 1 );
+		cmd( 5, 0b11111 );
+		state = TapState::reset;
+		if( jtag_verbose ) printf( "reset\n" );
+	}
+
+	// reset and read the IDCODE (0 if TDO isn't available)
+	let init() -> u32
+	{
+		reset();
+
+		trst( false );
+		scan_idle( 100 );
+
+		if( ! Hw::has_tdo )
+			return 0;
+
+		return (u32) get( capture_dr( 32 ) );
+	}
+};
@@ -1,7 +1,12 @@
 #include "defs.h"
 #include "die.h"
+#include "uring.h"
 #include <unistd.h>
+#include <string.h>
+#include <limits.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 //-------------- Privileged memory access ------------------------------------//
 //
@@ -29,6 +34,15 @@
 // process_vm_writev only for reads.  Can't be bothered to investigate the
 // cause of this at the moment; just replaced kmemcpy() by an accessor class.
 //
+
+// getpid() is a real syscall nowadays (glibc stopped caching it), so don't
+// waste one on every access.
+let static inline self_pid() -> pid_t
+{
+	static pid_t const pid = getpid();
+	return pid;
+}
+
 template< typename T >
 struct PrivilegedProxy {
 	static_assert( __has_trivial_copy(T), "" );
@@ -40,7 +54,7 @@ struct PrivilegedProxy {
 	let set( T const &value ) const -> T const & {
 		let dstv = iovec { &target, sizeof(T) };
 		let srcv = iovec { (void *)&value, sizeof(T) };
-		if( process_vm_readv( getpid(), &dstv, 1, &srcv, 1, 0 ) < 0 )
+		if( process_vm_readv( self_pid(), &dstv, 1, &srcv, 1, 0 ) < 0 )
 			die( "process_vm_readv: %m\n" );
 		return value;
 	}
@@ -48,7 +62,7 @@ struct PrivilegedProxy {
 	let get( T &value ) const -> T & {
 		let dstv = iovec { &value, sizeof(T) };
 		let srcv = iovec { (void *)&target, sizeof(T) };
-		if( process_vm_writev( getpid(), &srcv, 1, &dstv, 1, 0 ) < 0 )
+		if( process_vm_writev( self_pid(), &srcv, 1, &dstv, 1, 0 ) < 0 )
 			die( "process_vm_writev: %m\n" );
 		return value;
 	}
@@ -65,3 +79,234 @@ struct PrivilegedProxy {
 
 template< typename T >
 let constexpr privileged( T &target ) -> PrivilegedProxy<T> {  return target;  }
+
+
+//-------------- Batched privileged writes -----------------------------------//
+//
+// Same trick, but a whole sequence of writes is queued up and then performed
+// by a single process_vm_readv():  the values are copied from one contiguous
+// buffer into a list of targets, in order.  Repeated writes to the same target
+// are fine, the kernel simply processes one iovec after another.  A range of
+// consecutive targets can also be written by a single iovec.
+//
+// A batch consists of up to nsegs segments, each holding at most capacity
+// targets and values, which are performed one after another.
+//
+// Nothing is written until flush() is called (or the batch fills up), so
+// anything that depends on the writes having taken effect, such as sampling an
+// input, must flush first.
+//
+// Instead of process_vm_readv() (one syscall per segment), the segments can be
+// performed by io_uring:  the values are rendered into a memfd, and each
+// segment becomes a readv from the memfd into its targets.  The kernel copies
+// with plain stores there too, and the readv ops are linked so they're done
+// in order.  Since links don't extend past a submission, a batch is submitted
+// in one go.  All segments then cost one syscall, or with SQPOLL none at all
+// while the kernel's polling thread is awake.
+//
+// Or they can be written through /dev/mem, for targets within a physical range
+// registered beforehand:  each run of consecutive targets becomes a pwrite() at
+// its physical address, performed by the kernel with privileged stores too but
+// without relying on the process_vm_readv quirk.  Note however that some
+// architectures (arm among them) only allow read/write of RAM via /dev/mem,
+// which use_dev_mem() checks for.
+
+enum class PrivilegedEngine : u8 {
+	vm_readv,
+	uring,
+	uring_sqpoll,
+	dev_mem,
+};
+
+template< typename T, uint capacity = IOV_MAX, uint nsegs = 1 >
+struct PrivilegedBatch {
+	static_assert( __has_trivial_copy(T), "" );
+
+	iovec dst[ nsegs ][ capacity ];
+	T buffer[ nsegs * capacity ];
+	uint count[ nsegs ] {};		// targets
+	uint nvalues[ nsegs ] {};
+	uint seg = 0;			// segment being filled
+	uint limit = capacity;		// targets per segment
+
+	PrivilegedEngine engine = PrivilegedEngine::vm_readv;
+	T *mapped = NULL;		// values in memfd (if io_uring)
+	int memfd = -1;
+	Uring ring;
+
+	int devmem = -1;		// /dev/mem (if dev_mem)
+	uintptr_t devmem_va = 0;	// range of targets ...
+	uintptr_t devmem_size = 0;
+	off_t devmem_pa = 0;		// ... and its physical address
+
+	let values( uint s ) -> T * {
+		return ( mapped ? mapped : buffer ) + s * capacity;
+	}
+
+	let write( T &target, T const &value ) -> void {
+		write( &target, &value, 1 );
+	}
+
+	// write a range of consecutive targets with a single copy
+	let write( T *target, T const *src, uint n ) -> void {
+		if( n > capacity )
+			die( "privileged write of %u values too large\n", n );
+		if( ! room( n ) )
+			flush();
+		if( ! fits( seg, n ) )
+			++seg;
+		let v = values( seg ) + nvalues[ seg ];
+		dst[ seg ][ count[ seg ]++ ] = iovec { target, n * sizeof(T) };
+		forseq( i, 0u, n )
+			v[ i ] = src[ i ];
+		nvalues[ seg ] += n;
+	}
+
+	// perform the writes, returns the number of syscalls it took
+	let flush() -> uint {
+		if( ! pending() )
+			return 0;
+		let syscalls =
+			engine == PrivilegedEngine::vm_readv ? flush_vm_readv() :
+			engine == PrivilegedEngine::dev_mem ? flush_dev_mem() :
+			flush_uring();
+		forseq( s, 0u, seg + 1 ) {
+			count[ s ] = 0;
+			nvalues[ s ] = 0;
+		}
+		seg = 0;
+		return syscalls;
+	}
+
+	let flush_vm_readv() -> uint {
+		forseq( s, 0u, seg + 1 ) {
+			let size = nvalues[ s ] * sizeof(T);
+			let srcv = iovec { values( s ), size };
+			let res = process_vm_readv( self_pid(), dst[ s ], count[ s ], &srcv, 1, 0 );
+			if( res < 0 )
+				die( "process_vm_readv: %m\n" );
+			if( (size_t) res != size )
+				die( "process_vm_readv: short write (%zd of %zu bytes)\n", res, size );
+		}
+		return seg + 1;
+	}
+
+	let flush_uring() -> uint {
+		forseq( s, 0u, seg + 1 ) {
+			let &sqe = ring.prepare();
+			sqe.opcode = IORING_OP_READV;
+			sqe.fd = memfd;
+			sqe.off = s * capacity * sizeof(T);
+			sqe.addr = (uintptr_t) dst[ s ];
+			sqe.len = count[ s ];
+			sqe.user_data = s;
+			if( s < seg )
+				sqe.flags = IOSQE_IO_LINK;
+		}
+		return ring.submit( [this]( io_uring_cqe const &cqe ) {
+			let size = nvalues[ cqe.user_data ] * sizeof(T);
+			if( cqe.res < 0 )
+				die( "io_uring readv: %s\n", strerror( -cqe.res ) );
+			if( (size_t) cqe.res != size )
+				die( "io_uring readv: short write (%d of %zu bytes)\n",
+						cqe.res, size );
+		} );
+	}
+
+	let flush_dev_mem() -> uint {
+		let syscalls = 0u;
+		forseq( s, 0u, seg + 1 ) {
+			let src = (char const *) values( s );
+			for( uint i = 0; i < count[ s ]; ) {
+				let va = (uintptr_t) dst[ s ][ i ].iov_base;
+				let size = dst[ s ][ i++ ].iov_len;
+				while( i < count[ s ] &&
+						(uintptr_t) dst[ s ][ i ].iov_base == va + size )
+					size += dst[ s ][ i++ ].iov_len;
+				if( va - devmem_va >= devmem_size ||
+						size > devmem_size - ( va - devmem_va ) )
+					die( "privileged write to %p not via /dev/mem\n", (void *) va );
+				let res = pwrite( devmem, src, size, devmem_pa + ( va - devmem_va ) );
+				if( res < 0 )
+					die( "/dev/mem: %m\n" );
+				if( (size_t) res != size )
+					die( "/dev/mem: short write (%zd of %zu bytes)\n", res, size );
+				src += size;
+				++syscalls;
+			}
+		}
+		return syscalls;
+	}
+
+	let pending() const -> bool {  return count[ 0 ] != 0;  }
+
+	let fits( uint s, uint n ) const -> bool {
+		return count[ s ] < limit && nvalues[ s ] + n <= capacity;
+	}
+
+	// limit the number of targets per segment, i.e. per syscall with
+	// process_vm_readv() or per op with io_uring
+	let set_limit( uint n ) -> void {
+		flush();
+		limit = min( max( n, 1u ), capacity );
+	}
+
+	// whether a write of n values fits without flushing first
+	let room( uint n ) const -> bool {
+		return fits( seg, n ) || seg + 1 < nsegs;
+	}
+
+	// switch to io_uring, returns false (and stays with process_vm_readv) if
+	// it's unavailable
+	let use_uring( bool sqpoll ) -> bool {
+		if( ring.ok() && ring.sqpoll == sqpoll ) {
+			select( sqpoll ? PrivilegedEngine::uring_sqpoll : PrivilegedEngine::uring );
+			return true;
+		}
+		flush();
+		let size = sizeof( buffer );
+		let fd = memfd_create( "privileged-batch", MFD_CLOEXEC );
+		if( fd < 0 )
+			return false;
+		let ptr = ftruncate( fd, size ) < 0 ? MAP_FAILED :
+			mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+		if( ptr == MAP_FAILED ) {
+			close( fd );
+			return false;
+		}
+		if( ! ring.setup( nsegs, sqpoll ) ) {
+			munmap( ptr, size );
+			close( fd );
+			return false;
+		}
+		mapped = (T *) ptr;
+		memfd = fd;
+		engine = sqpoll ? PrivilegedEngine::uring_sqpoll : PrivilegedEngine::uring;
+		return true;
+	}
+
+	// switch back to an engine that has been used before
+	let select( PrivilegedEngine e ) -> void {
+		flush();
+		engine = e;
+	}
+
+	// switch to /dev/mem, for targets in the given range, which is mapped
+	// at physical address pa.  returns false (leaving the engine unchanged)
+	// if /dev/mem can't be used to access it.
+	let use_dev_mem( void *va, size_t size, off_t pa ) -> bool {
+		flush();
+		if( devmem < 0 )
+			devmem = open( "/dev/mem", O_RDWR | O_DSYNC | O_CLOEXEC );
+		if( devmem < 0 )
+			return false;
+		T probe;
+		if( pread( devmem, &probe, sizeof probe, pa ) != sizeof probe )
+			return false;
+		devmem_va = (uintptr_t) va;
+		devmem_size = size;
+		devmem_pa = pa;
+		engine = PrivilegedEngine::dev_mem;
+		return true;
+	}
+};
@@ -0,0 +1,441 @@
+#include "defs.h"
+#include "die.h"
+#include "jtag.h"
+#include "chain.h"
+#include "translog.h"
+#include "icepick.h"
+#include "dap.h"
+#include "target-subarctic.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+
+// Replays a transaction log recorded by jbang (JBANG_TRANSLOG=file, see
+// translog.h) through the chain and the JTAG engine, against a target that
+// answers each scan with the response recorded for it:
+//
+//	replay LOG
+//	replay -p LOG		(just print the log)
+//
+// Every DR scan reaching the pins is checked against the log:  its length,
+// the data shifted in, and the instruction its TAP was given.  So is every
+// response coming back up through the engine.  Any divergence is reported
+// (and makes the exit status 1), as are the counts of scans, TCK cycles, pin
+// writes and syscalls the replay took, next to those of the recorded session
+// as a whole.  These only cover the transactions though, not e.g. the scans of
+// chain discovery, nor the batching of the DAP code above them.
+
+let constexpr replay_max_reports = 16u;
+
+let static ndivergences = 0u;
+
+[[ gnu::format( printf, 2, 3 ) ]]
+let static diverged( uint index, char const *fmt, ... ) -> void
+{
+	if( ndivergences++ >= replay_max_reports )
+		return;
+	if( index != ~0u )
+		printf( "record %u: ", index );
+	else
+		printf( "past the end: " );
+	va_list ap;
+	va_start( ap, fmt );
+	vprintf( fmt, ap );
+	va_end( ap );
+}
+
+
+//-------------- Replay target -----------------------------------------------//
+//
+// A JTAG backend with nothing behind the pins but a TAP controller and a queue
+// of the DR scans it should see next, each with the response to give.  Pin
+// writes and syscalls are counted the way the simulated target does.
+
+struct Expect {
+	uint index;	// of the record it's for
+	uint nbits;	// length of the chain's DR
+	u64 out;	// data to be shifted in
+	u64 in;		// response to shift out
+	uint ir_pos;	// where the TAP's instruction is in the chain's IR
+	uint ir_len;	// (0 if it needn't be checked)
+	u64 ir;
+};
+
+let constexpr replay_expect_size = 1024u;  // must exceed scan_queue_size
+
+struct ReplayTarget {
+	let static constexpr has_tdo = true;
+	let static constexpr has_rtck = false;
+
+	HwStats stats {};
+	uint dr_scans = 0;
+	uint ir_scans = 0;
+
+	bool trst_level = false;
+	bool tck_level = false;
+	bool tms_level = false;
+	bool tdi_level = false;
+	bool tdo_level = false;
+	uint pending = 0;
+
+	TapState state = TapState::reset;
+	u64 ir = 0;		// as last updated
+	bool ir_known = false;
+	u64 sr = 0;		// data being shifted out
+	u64 shifted = 0;	// data shifted in
+	uint nshifted = 0;
+
+	array< Expect, replay_expect_size > expect {};
+	uint head = 0;
+	uint tail = 0;
+
+	let init() -> void {}
+
+	let push( Expect const &e ) -> void
+	{
+		if( head - tail == replay_expect_size )
+			die( "replay: too many scans outstanding\n" );
+		expect[ head++ % replay_expect_size ] = e;
+	}
+
+	let write( bool &pin, bool level ) -> void {
+		if( pin == level )
+			return;
+		pin = level;
+		if( pending == IOV_MAX )
+			flush();
+		++pending;
+		++stats.pin_writes;
+	}
+
+	let trst( bool level ) -> void {
+		write( trst_level, level );
+		if( ! level )
+			tap_reset();
+	}
+
+	let tck( bool level ) -> void {
+		let prev = tck_level;
+		write( tck_level, level );
+		if( level && ! prev )
+			rising_edge();
+		else if( ! level && prev && ( state == TapState::dr_shift ||
+					state == TapState::ir_shift ) )
+			tdo_level = sr & 1;
+	}
+
+	let tms( bool level ) -> void {  write( tms_level, level );  }
+	let tdi( bool level ) -> void {  write( tdi_level, level );  }
+
+	let tdo() -> bool {
+		flush();
+		return tdo_level;
+	}
+
+	let rtck() -> bool {  return false;  }
+
+	let flush() -> void {
+		if( pending )
+			++stats.syscalls;
+		pending = 0;
+	}
+
+	let tap_reset() -> void
+	{
+		state = TapState::reset;
+		ir_known = false;
+	}
+
+	let rising_edge() -> void
+	{
+		++stats.tck_cycles;
+		if( ! trst_level )
+			return;
+
+		switch( state ) {
+		case TapState::ir_capture:
+		case TapState::dr_capture:
+			sr = state == TapState::dr_capture && tail != head ?
+				expect[ tail % replay_expect_size ].in : 0;
+			shifted = 0;
+			nshifted = 0;
+			break;
+		case TapState::ir_shift:
+		case TapState::dr_shift:
+			if( nshifted < 64 )
+				shifted |= (u64) tdi_level << nshifted;
+			++nshifted;
+			sr >>= 1;
+			break;
+		default:
+			break;
+		}
+
+		let prev = state;
+		state = tap_next( state, tms_level );
+		if( state == prev )
+			return;
+
+		if( state == TapState::reset ) {
+			tap_reset();
+		} else if( state == TapState::ir_update ) {
+			++ir_scans;
+			ir = shifted;
+			ir_known = nshifted <= 64;
+		} else if( state == TapState::dr_update ) {
+			++dr_scans;
+			check_dr();
+		}
+	}
+
+	let check_dr() -> void
+	{
+		if( tail == head ) {
+			diverged( ~0u, "unexpected DR scan of %u bits\n", nshifted );
+			return;
+		}
+		let &e = expect[ tail++ % replay_expect_size ];
+		if( nshifted != e.nbits ) {
+			diverged( e.index, "DR scan of %u bits rather than %u\n",
+					nshifted, e.nbits );
+			return;
+		}
+		if( shifted != e.out )
+			diverged( e.index, "DR scan shifted in 0x%" PRIx64
+					" rather than 0x%" PRIx64 "\n", shifted, e.out );
+		let mask = ( (u64) 1 << e.ir_len ) - 1;
+		if( e.ir_len && ir_known && ( ir >> e.ir_pos & mask ) != e.ir )
+			diverged( e.index, "DR scan with instruction 0x%" PRIx64
+					" rather than 0x%" PRIx64 "\n",
+					ir >> e.ir_pos & mask, e.ir );
+	}
+};
+
+
+//-------------- Replay driver -----------------------------------------------//
+
+using Hw = ReplayTarget;
+
+struct ReplayCheck {
+	uint index;
+	Scan scan;
+	u64 response;
+};
+
+struct Replay {
+	Hw hw {};
+	Jtag<Hw> jtag { hw };
+	Chain<Hw> chain { jtag, chain_taps };
+
+	uint nrecords = 0;
+	uint ndap_ops = 0;
+	uint nrouter = 0;
+
+	// responses to check once they come in
+	array< ReplayCheck, replay_expect_size > checks {};
+	uint head = 0;
+	uint tail = 0;
+
+	let drain() -> void
+	{
+		for( ; tail != head; ++tail ) {
+			let &c = checks[ tail % replay_expect_size ];
+			if( ! jtag.resolved( c.scan ) )
+				return;
+			let x = jtag.get( c.scan );
+			if( x != c.response )
+				diverged( c.index, "response 0x%" PRIx64 " rather than 0x%" PRIx64 "\n",
+						x, c.response );
+		}
+	}
+
+	// expect a DR scan of TAP t, with data shifted in and out in its place
+	let expect( uint t, uint nbits, u64 out, u64 in ) -> void
+	{
+		let before = chain.pad_before( t );
+		let ir_pos = 0u;
+		forseq( i, 0u, t )
+			if( chain.linked[ i ] )
+				ir_pos += chain.taps[ i ].ir_len;
+		hw.push( Expect { nrecords, before + nbits + chain.pad_after( t ),
+				out << before, in << before, ir_pos,
+				chain.taps[ t ].ir_len, chain.selected[ t ] } );
+	}
+
+	let capture( uint t, uint nbits, u64 out, u64 response ) -> void
+	{
+		expect( t, nbits, out, response );
+		let scan = chain.capture_dr( t, nbits, out );
+		if( head - tail == replay_expect_size )
+			die( "replay: too many responses outstanding\n" );
+		checks[ head++ % replay_expect_size ] = ReplayCheck { nrecords, scan, response };
+	}
+
+	let tap( TransRecord const &rec ) -> uint
+	{
+		if( rec.tap >= chain.ntaps )
+			die( "record %u: no TAP %u in chain\n", nrecords, rec.tap );
+		return rec.tap;
+	}
+
+	let play( TransRecord const &rec ) -> void
+	{
+		drain();
+		switch( rec.kind ) {
+		case TransKind::reset: {
+			// the IDCODE read of Jtag::init, with only the chain's
+			// own TAPs in it
+			hw.push( Expect { nrecords, 32, 0, rec.response, 0, 0, 0 } );
+			let idcode = chain.init();
+			if( idcode != rec.response )
+				diverged( nrecords, "JTAG ID %08x rather than %08x\n",
+						idcode, (u32) rec.response );
+			break;
+		}
+		case TransKind::link:
+			chain.link( tap( rec ) );
+			break;
+		case TransKind::idle:
+			jtag.scan_idle( rec.arg );
+			break;
+		case TransKind::dap_op: {
+			let t = tap( rec );
+			chain.select( t, rec.ir );
+			capture( t, 3 + 32, rec.op | (u64) rec.arg << 3, rec.response );
+			++ndap_ops;
+			break;
+		}
+		case TransKind::router: {
+			let t = tap( rec );
+			chain.select( t, rec.ir );
+			expect( t, 32, rec.arg, 0 );
+			chain.scan_dr( t, 32, rec.arg );
+			if( rec.op )
+				capture( t, 32, 0, rec.response );
+			++nrouter;
+			break;
+		}
+		default:
+			die( "record %u: invalid\n", nrecords );
+		}
+		++nrecords;
+	}
+
+	let finish() -> void
+	{
+		jtag.flush();
+		drain();
+		if( hw.tail != hw.head )
+			diverged( hw.expect[ hw.tail % replay_expect_size ].index,
+					"%u DR scans missing\n", hw.head - hw.tail );
+	}
+};
+
+let static replay = Replay {};
+
+
+//-------------- Printing ----------------------------------------------------//
+
+let static dap_ir_name( uint ir ) -> char const *
+{
+	switch( ir ) {
+	case dap::ir_abort:	return "abort";
+	case dap::ir_dpacc:	return "dpacc";
+	case dap::ir_apacc:	return "apacc";
+	}
+	return "?";
+}
+
+let static print_record( uint index, TransRecord const &rec ) -> void
+{
+	printf( "%6u  ", index );
+	switch( rec.kind ) {
+	case TransKind::reset:
+		printf( "reset, JTAG ID %08x\n", (u32) rec.response );
+		break;
+	case TransKind::link:
+		printf( "link %s\n", rec.tap < countof( chain_taps ) ?
+				chain_taps[ rec.tap ].name : "?" );
+		break;
+	case TransKind::idle:
+		printf( "idle %u\n", rec.arg );
+		break;
+	case TransKind::dap_op:
+		printf( "%s %x %08x -> ack %u, %08x\n", dap_ir_name( rec.ir ),
+				rec.op, rec.arg, (uint)( rec.response & 7 ),
+				(u32)( rec.response >> 3 ) );
+		break;
+	case TransKind::router:
+		printf( "router %s %02x %06x", rec.arg >> 31 ? "write" : "read",
+				rec.arg >> 24 & 0x7f, rec.arg & 0xffffff );
+		if( rec.op )
+			printf( " -> %08x", (u32) rec.response );
+		printf( "\n" );
+		break;
+	default:
+		printf( "invalid (%u)\n", (uint) rec.kind );
+	}
+}
+
+
+//-------------- main --------------------------------------------------------//
+
+let main( int argc, char **argv ) -> int
+{
+	let print = argc == 3 && ! strcmp( argv[ 1 ], "-p" );
+	if( argc != 2 && ! print )
+		die( "usage: %s [-p] LOG\n", argv[ 0 ] );
+	let path = argv[ argc - 1 ];
+
+	let in = fopen( path, "rb" );
+	if( ! in )
+		die( "%s: %m\n", path );
+	let magic_len = strlen( translog_magic );
+	char magic[ 16 ];
+	if( fread( magic, 1, magic_len, in ) != magic_len || memcmp( magic, translog_magic, magic_len ) )
+		die( "%s: not a transaction log\n", path );
+
+	let index = 0u;
+	let rec = TransRecord {};
+	for( ;; ) {
+		if( fread( &rec, sizeof rec, 1, in ) != 1 )
+			die( "%s: %s\n", path, ferror( in ) ? "read error" : "truncated" );
+		if( rec.kind == TransKind::end )
+			break;
+		if( print )
+			print_record( index, rec );
+		else
+			replay.play( rec );
+		++index;
+	}
+	let recorded = HwStats {};
+	if( fread( &recorded, sizeof recorded, 1, in ) != 1 )
+		die( "%s: truncated\n", path );
+	fclose( in );
+	if( print )
+		return 0;
+
+	replay.finish();
+	let &hw = replay.hw;
+	printf( "%s: %u records (%u DAP ops, %u router accesses)\n", path,
+			replay.nrecords, replay.ndap_ops, replay.nrouter );
+	printf( "  replay:   %u DR + %u IR scans, %llu TCK cycles, %llu pin writes, %llu syscalls\n",
+			hw.dr_scans, hw.ir_scans,
+			(unsigned long long) hw.stats.tck_cycles,
+			(unsigned long long) hw.stats.pin_writes,
+			(unsigned long long) hw.stats.syscalls );
+	printf( "  recorded: %llu TCK cycles, %llu pin writes, %llu syscalls (whole session)\n",
+			(unsigned long long) recorded.tck_cycles,
+			(unsigned long long) recorded.pin_writes,
+			(unsigned long long) recorded.syscalls );
+	if( ndivergences ) {
+		if( ndivergences > replay_max_reports )
+			printf( "  ... (%u more)\n", ndivergences - replay_max_reports );
+		printf( "  %u divergences\n", ndivergences );
+		return 1;
+	}
+	printf( "  no divergences\n" );
+	return 0;
+}
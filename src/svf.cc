@@ -0,0 +1,881 @@
+#include "defs.h"
+#include "die.h"
+#include "jtag.h"
+#include "wave.h"
+#ifdef JBANG_SIM
+#include "hw-sim.h"
+#else
+#include "hw-subarctic.h"
+#endif
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Plays back an SVF or XSVF file, i.e. test or programming vectors as
+// generated by vendor tools, through the JTAG engine:
+//
+//	svf FILE.svf
+//	svf FILE.xsvf
+//
+// The file is mapped rather than read and executed as it's parsed, and the
+// vectors are left in the file as they are:  each 64-bit word of a scan is
+// decoded from the file just before it gets shifted, and what's shifted out
+// is compared against the expected TDO a word at a time, under the mask.  So
+// however large the file or its scans, memory use stays the same.
+//
+// Not supported are the SVF PIO/PIOMAP statements and RUNTEST in SCK
+// cycles, nor the XSVF commands for partial and incrementing scans.
+
+// the JTAG backend this program drives the pins with:  the padconf pins, or
+// for the svf-sim build a simulated target.  what it does is recorded if
+// JBANG_RECORD is set (see wave.h).
+#ifdef JBANG_SIM
+using Hw = Recorded< SimTarget >;
+#else
+using Hw = Recorded< Padconf >;
+#endif
+
+
+//-------------- Vectors -----------------------------------------------------//
+//
+// A vector as it appears in the file:  hex digits (SVF) or bytes (XSVF), most
+// significant first, so the first bits to shift are at the end.
+//
+// Hex digits are decoded eight at a time within a 64-bit word (SWAR), as are
+// they checked for being valid.  A vector broken up by whitespace (e.g. over
+// several lines) is decoded where it is too, skipping the whitespace as it
+// goes through the text eight chars at a time.
+
+let constexpr ones8 = 0x0101'0101'0101'0101ull;
+
+let static load8( char const *p ) -> u64
+{
+	u64 x;
+	memcpy( &x, p, 8 );
+	return x;
+}
+
+// high bit set in each byte whose value is between m and n (exclusive), for
+// m and n at most 128
+let constexpr bytes_between( u64 x, u64 m, u64 n ) -> u64
+{
+	return ( ones8 * ( 127 + n ) - ( x & ones8 * 127 ) ) & ~x &
+		( ( x & ones8 * 127 ) + ones8 * ( 127 - m ) ) & ones8 * 128;
+}
+
+// high bit set in each of 8 chars that is a hex digit
+let static hex_bytes( u64 x ) -> u64
+{
+	let digit = bytes_between( x, '0' - 1, '9' + 1 );
+	let letter = bytes_between( x | ones8 * 0x20, 'a' - 1, 'f' + 1 );
+	return digit | letter;
+}
+
+// the same for whitespace (as by isspace)
+let static space_bytes( u64 x ) -> u64
+{
+	return bytes_between( x, '\t' - 1, '\r' + 1 ) | bytes_between( x, ' ' - 1, ' ' + 1 );
+}
+
+// whether 8 chars are all hex digits
+let static is_hex8( u64 x ) -> bool
+{
+	return hex_bytes( x ) == ones8 * 128;
+}
+
+// value of 8 hex digits (as loaded, the first one most significant)
+let static hex8( u64 x ) -> u32
+{
+	// letters have bit 6 set and 1-6 in their low nibble
+	x = ( x & ones8 * 0x0f ) + ( x >> 6 & ones8 ) * 9;
+	// gather the nibbles
+	x = ( x << 4 | x >> 8 ) & 0x00ff'00ff'00ff'00ff;
+	x = ( x << 8 | x >> 16 ) & 0x0000'ffff'0000'ffff;
+	return (u32)( x << 16 | x >> 32 );
+}
+
+// the n (at most 8) hex digits before end, or n bytes for a binary vector
+let static hex_before( char const *end, uint n ) -> u32
+{
+	let x = load8( "00000000" );
+	memcpy( (char *) &x + 8 - n, end - n, n );
+	return hex8( x );
+}
+let static bytes_before( char const *end, uint n ) -> u64
+{
+	u64 x = 0;
+	memcpy( (char *) &x + 8 - n, end - n, n );
+	return __builtin_bswap64( x );
+}
+
+struct Vec {
+	char const *data = NULL;	// if NULL, every bit is fill
+	uint size = 0;		// in digits or bytes
+	bool hex = true;
+	u64 fill = 0;
+
+	// if the digits are broken up by whitespace, the length of the text
+	// (0 otherwise).  the words are then found by going through the text
+	// from the end, which is remembered between calls:  where the digits of
+	// word at_word end.  scans go through the words in order.
+	uint text_size = 0;
+	mutable uint at_word = 0;
+	mutable uint at_end = 0;
+
+	// the n hex digits before end in the text, into out, moving end past
+	// them
+	let digits_before( uint &end, char *out, uint n ) const -> void
+	{
+		while( n && end >= 8 ) {
+			let hex = hex_bytes( load8( data + end - 8 ) );
+			if( hex == ones8 * 128 && n >= 8 ) {
+				n -= 8;
+				end -= 8;
+				memcpy( out + n, data + end, 8 );
+				continue;
+			}
+			// pick the digits out one by one, last first
+			for( let b = 8u; b-- && n; --end )
+				if( hex >> ( b * 8 + 7 ) & 1 )
+					out[ --n ] = data[ end - 1 ];
+		}
+		for( ; n && end; --end )
+			if( isxdigit( data[ end - 1 ] ) )
+				out[ --n ] = data[ end - 1 ];
+	}
+
+	let spaced_word( uint w ) const -> u64
+	{
+		char digits[ 16 ];
+		if( w < at_word ) {
+			at_word = 0;
+			at_end = text_size;
+		}
+		for( ; at_word < w; ++at_word )
+			digits_before( at_end, digits, 16 );
+		let n = min( size - w * 16, 16u );
+		digits_before( at_end, digits, n );
+		++at_word;
+		let lo = hex_before( digits + n, min( n, 8u ) );
+		let hi = n > 8 ? hex_before( digits + n - 8, n - 8 ) : 0;
+		return (u64) hi << 32 | lo;
+	}
+
+	// bits 64w and up
+	let word( uint w ) const -> u64
+	{
+		if( ! data )
+			return fill;
+		let per_word = hex ? 16u : 8u;
+		if( w >= ( size + per_word - 1 ) / per_word )
+			return 0;
+		if( text_size )
+			return spaced_word( w );
+		let end = data + size - w * per_word;
+		let n = min( size - w * per_word, per_word );
+		if( ! hex )
+			return bytes_before( end, n );
+		let lo = hex_before( end, min( n, 8u ) );
+		let hi = n > 8 ? hex_before( end - 8, n - 8 ) : 0;
+		return (u64) hi << 32 | lo;
+	}
+
+	// n (at most 64) bits starting at pos
+	let get( uint pos, uint n ) const -> u64
+	{
+		let w = pos / 64;
+		let b = pos % 64;
+		let x = word( w ) >> b;
+		if( b && b + n > 64 )
+			x |= word( w + 1 ) << ( 64 - b );
+		return n < 64 ? x & ( ( (u64) 1 << n ) - 1 ) : x;
+	}
+};
+
+// the data of an SVF scan command (SIR, SDR, and their headers and trailers),
+// or of an XSVF scan
+struct Part {
+	uint nbits = 0;
+	Vec tdi, tdo, mask, smask;
+	bool check = false;	// TDO given
+
+	// the vectors not given keep their values if the length stays the same
+	let resize( uint n ) -> void
+	{
+		check = false;
+		if( n == nbits )
+			return;
+		nbits = n;
+		tdi = Vec {};
+		tdo = Vec {};
+		mask = smask = Vec { NULL, 0, true, ~(u64) 0 };
+	}
+};
+
+
+//-------------- Playing back ------------------------------------------------//
+
+let static now() -> double
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct Player {
+	Hw hw {};
+	Jtag<Hw> jtag { hw };
+
+	// where to report errors:  line, or offset of the command (XSVF)
+	char const *path = NULL;
+	uint line = 0;
+	bool offsets = false;
+
+	uint nscans = 0;
+	uint nchecks = 0;
+
+	let init() -> void
+	{
+		hw.init();
+		hw.recorder = wave_record_env();
+		jtag.reset();
+		jtag.trst( false );
+	}
+
+	// test-logic-reset, whatever state the TAP is in
+	let tap_reset() -> void
+	{
+		jtag.cmd( 5, 0b11111 );
+		jtag.state = TapState::reset;
+	}
+
+	let tap_goto( TapState s ) -> void
+	{
+		if( s == TapState::reset )
+			tap_reset();
+		else
+			jtag.tap_goto( s );
+	}
+
+	// stay in a stable state for (at least) the given number of cycles and
+	// seconds
+	let wait( TapState s, uint ncycles, double secs ) -> void
+	{
+		tap_goto( s );
+		let tms = s == TapState::reset ? ~0u : 0u;
+		let t0 = now();
+		for( ; ncycles >= 32; ncycles -= 32 )
+			jtag.cmd( 32, tms );
+		jtag.cmd( ncycles, tms );
+		if( secs <= 0 )
+			return;
+		jtag.flush();
+		let left = secs - ( now() - t0 );
+		if( left > 0 )
+			usleep( (useconds_t)( left * 1e6 ) + 1 );
+	}
+
+	// shift the parts one after the other through the IR or DR, then go to
+	// the end state.  returns false on a TDO mismatch, which is reported if
+	// report is set.
+	template< size_t nparts >
+	let scan( TapState shift, Part const *( &parts )[ nparts ], TapState end,
+			bool report = true ) -> bool
+	{
+		let nbits = 0u;
+		let check = false;
+		for( let p : parts ) {
+			nbits += p->nbits;
+			check = check || p->check;
+		}
+		++nscans;
+		if( nbits == 0 ) {
+			tap_goto( end );
+			return true;
+		}
+
+		// 64 bits of the scan, starting at pos, from the given vectors
+		let bits = [&]( uint pos, Vec Part::*vec, bool checked_only ) -> u64 {
+			u64 x = 0;
+			let off = 0u;
+			for( let p : parts ) {
+				let lo = max( pos, off );
+				let hi = min( pos + 64, off + p->nbits );
+				if( lo < hi && ( p->check || ! checked_only ) )
+					x |= ( p->*vec ).get( lo - off, hi - lo ) << ( lo - pos );
+				off += p->nbits;
+			}
+			return x;
+		};
+
+		let bad = false;
+		let bad_pos = 0u;
+		let bad_in = (u64) 0;
+		jtag.shift_words( shift, nbits,
+			[&]( uint w ) {  return bits( w * 64, &Part::tdi, false );  },
+			[&]( uint w, u64 in ) {
+				if( ! check || bad )
+					return;
+				let pos = w * 64;
+				let mask = bits( pos, &Part::mask, true );
+				if( ( in ^ bits( pos, &Part::tdo, true ) ) & mask ) {
+					bad = true;
+					bad_pos = pos;
+					bad_in = in;
+				}
+			}, check );
+		nchecks += check;
+		tap_goto( end );
+
+		if( bad && report ) {
+			fprintf( stderr, offsets ? "%s: offset %u: " : "%s:%u: ", path, line );
+			fprintf( stderr, "TDO mismatch in bits %u-%u of %u:\n"
+					"\tgot      %016llx\n\texpected %016llx\n\tmask     %016llx\n",
+					bad_pos, min( bad_pos + 64, nbits ) - 1, nbits,
+					(unsigned long long) bad_in,
+					(unsigned long long) bits( bad_pos, &Part::tdo, true ),
+					(unsigned long long) bits( bad_pos, &Part::mask, true ) );
+		}
+		return ! bad;
+	}
+};
+
+
+//-------------- SVF ---------------------------------------------------------//
+
+// in the order of TapState
+constexpr char const *svf_states[ tap_nstates ] = {
+	"RESET", "IDLE",
+	"DRSELECT", "DRCAPTURE", "DRSHIFT", "DREXIT1",
+	"DRPAUSE", "DREXIT2", "DRUPDATE",
+	"IRSELECT", "IRCAPTURE", "IRSHIFT", "IREXIT1",
+	"IRPAUSE", "IREXIT2", "IRUPDATE",
+};
+
+struct Token {
+	char const *s;
+	uint n;
+};
+
+struct Svf {
+	Player &player;
+	char const *p;
+	char const *const end;
+
+	Svf( Player &player, char const *data, size_t size )
+		: player( player ), p( data ), end( data + size ) {}
+
+	TapState end_ir = TapState::idle;
+	TapState end_dr = TapState::idle;
+	TapState run_state = TapState::idle;
+	TapState run_end = TapState::idle;
+
+	Part hir, sir, tir;
+	Part hdr, sdr, tdr;
+
+	[[ noreturn ]]
+	let error( char const *fmt, ... ) -> void
+	{
+		char msg[ 256 ];
+		va_list ap;
+		va_start( ap, fmt );
+		vsnprintf( msg, sizeof msg, fmt, ap );
+		va_end( ap );
+		die( "%s:%u: %s\n", player.path, player.line, msg );
+	}
+
+	// skip whitespace and comments
+	let skip() -> void
+	{
+		while( p < end ) {
+			if( *p == '\n' )
+				++player.line;
+			if( *p == '!' || ( *p == '/' && p + 1 < end && p[ 1 ] == '/' ) ) {
+				let eol = (char const *) memchr( p, '\n', end - p );
+				p = eol ? eol : end;
+				continue;
+			}
+			if( ! isspace( *p ) )
+				break;
+			++p;
+		}
+	}
+
+	// next word, empty at the end of the statement (which isn't consumed)
+	let word() -> Token
+	{
+		skip();
+		let s = p;
+		while( p < end && ! isspace( *p ) && ! strchr( ";()", *p ) )
+			++p;
+		return Token { s, (uint)( p - s ) };
+	}
+
+	let static is( Token t, char const *kw ) -> bool
+	{
+		return t.n == strlen( kw ) && ! strncasecmp( t.s, kw, t.n );
+	}
+
+	let end_of_statement() -> void
+	{
+		skip();
+		if( p == end || *p != ';' )
+			error( "';' expected" );
+		++p;
+	}
+
+	let number( Token t ) -> double
+	{
+		char buf[ 64 ];
+		if( t.n == 0 || t.n >= sizeof buf )
+			error( "number expected" );
+		memcpy( buf, t.s, t.n );
+		buf[ t.n ] = 0;
+		char *e;
+		let x = strtod( buf, &e );
+		if( *e || x < 0 )
+			error( "invalid number \"%s\"", buf );
+		return x;
+	}
+
+	let count( Token t ) -> uint
+	{
+		let x = number( t );
+		if( x > 1e9 || x != (uint) x )
+			error( "invalid count %g", x );
+		return (uint) x;
+	}
+
+	let state( Token t, bool stable = false ) -> TapState
+	{
+		forseq( s, 0u, tap_nstates ) {
+			if( ! is( t, svf_states[ s ] ) )
+				continue;
+			if( stable && ( ! tap_stable( (TapState) s ) ||
+					s == (uint) TapState::dr_shift || s == (uint) TapState::ir_shift ) )
+				error( "%s is not a valid end state", svf_states[ s ] );
+			return (TapState) s;
+		}
+		error( "unknown state \"%.*s\"", t.n, t.s );
+	}
+
+	let is_state( Token t ) -> bool
+	{
+		for( let name : svf_states )
+			if( is( t, name ) )
+				return true;
+		return false;
+	}
+
+	// a parenthesized hex vector, left where it is in the file.  it's
+	// checked eight chars at a time, and if there's whitespace in it (e.g.
+	// line breaks), the digits are counted.
+	let vector( Vec &v ) -> void
+	{
+		skip();
+		if( p == end || *p != '(' )
+			error( "'(' expected" );
+		++p;
+		let close = (char const *) memchr( p, ')', end - p );
+		if( ! close )
+			error( "')' missing" );
+		let n = (uint)( close - p );
+
+		let i = 0u;
+		while( i + 8 <= n && is_hex8( load8( p + i ) ) )
+			i += 8;
+		v = Vec { p, n, true, 0 };
+		if( i < n ) {
+			v.size = i;
+			for( ; i + 8 <= n; i += 8 ) {
+				let x = load8( p + i );
+				let hex = hex_bytes( x );
+				let newline = bytes_between( x, '\n' - 1, '\n' + 1 );
+				let bad = ~( hex | space_bytes( x ) ) & ones8 * 128;
+				// the line breaks up to the first invalid char
+				player.line += __builtin_popcountll( newline & ( ( bad & -bad ) - 1 ) );
+				if( bad )
+					error( "invalid hex digit '%c'", p[ i + __builtin_ctzll( bad ) / 8 ] );
+				v.size += __builtin_popcountll( hex );
+			}
+			for( ; i < n; ++i ) {
+				if( isxdigit( p[ i ] ) )
+					++v.size;
+				else if( p[ i ] == '\n' )
+					++player.line;
+				else if( ! isspace( p[ i ] ) )
+					error( "invalid hex digit '%c'", p[ i ] );
+			}
+			if( v.size < n )
+				v.text_size = v.at_end = n;
+		}
+		p = close + 1;
+	}
+
+	// HIR, SIR, TIR, HDR, SDR or TDR:  length, then any of the vectors
+	let part( Part &part ) -> void
+	{
+		part.resize( count( word() ) );
+		for( ;; ) {
+			let t = word();
+			if( t.n == 0 )
+				break;
+			let i = is( t, "TDI" ) ? 0 : is( t, "TDO" ) ? 1 :
+				is( t, "MASK" ) ? 2 : is( t, "SMASK" ) ? 3 : -1;
+			if( i < 0 )
+				error( "unexpected \"%.*s\"", t.n, t.s );
+			Vec *const vecs[] = { &part.tdi, &part.tdo, &part.mask, &part.smask };
+			vector( *vecs[ i ] );
+			if( i == 1 )
+				part.check = true;
+		}
+		end_of_statement();
+	}
+
+	let runtest() -> void
+	{
+		let t = word();
+		if( is_state( t ) ) {
+			run_state = run_end = state( t, true );
+			t = word();
+		}
+		let ncycles = 0u;
+		let secs = 0.0;
+		let n = t;
+		t = word();
+		if( is( t, "TCK" ) ) {
+			ncycles = count( n );
+			t = word();
+			if( t.n && ! is( t, "MAXIMUM" ) && ! is( t, "ENDSTATE" ) ) {
+				secs = number( t );
+				if( ! is( word(), "SEC" ) )
+					error( "SEC expected" );
+				t = word();
+			}
+		} else if( is( t, "SEC" ) ) {
+			secs = number( n );
+			t = word();
+		} else if( is( t, "SCK" ) ) {
+			error( "RUNTEST in SCK cycles not supported" );
+		} else {
+			error( "TCK or SEC expected" );
+		}
+		if( is( t, "MAXIMUM" ) ) {
+			number( word() );
+			if( ! is( word(), "SEC" ) )
+				error( "SEC expected" );
+			t = word();
+		}
+		if( is( t, "ENDSTATE" ) ) {
+			run_end = state( word(), true );
+			t = word();
+		}
+		if( t.n )
+			error( "unexpected \"%.*s\"", t.n, t.s );
+		end_of_statement();
+
+		player.wait( run_state, ncycles, secs );
+		player.tap_goto( run_end );
+	}
+
+	let statement() -> void
+	{
+		let cmd = word();
+		if( cmd.n == 0 )
+			error( "command expected" );
+
+		if( is( cmd, "SIR" ) ) {
+			part( sir );
+			Part const *parts[] = { &hir, &sir, &tir };
+			if( ! player.scan( TapState::ir_shift, parts, end_ir ) )
+				exit( EXIT_FAILURE );
+		} else if( is( cmd, "SDR" ) ) {
+			part( sdr );
+			Part const *parts[] = { &hdr, &sdr, &tdr };
+			if( ! player.scan( TapState::dr_shift, parts, end_dr ) )
+				exit( EXIT_FAILURE );
+		} else if( is( cmd, "HIR" ) ) {
+			part( hir );
+		} else if( is( cmd, "TIR" ) ) {
+			part( tir );
+		} else if( is( cmd, "HDR" ) ) {
+			part( hdr );
+		} else if( is( cmd, "TDR" ) ) {
+			part( tdr );
+		} else if( is( cmd, "RUNTEST" ) ) {
+			runtest();
+		} else if( is( cmd, "STATE" ) ) {
+			for( let t = word(); t.n; t = word() )
+				player.tap_goto( state( t ) );
+			if( ! tap_stable( player.jtag.state ) )
+				error( "STATE must end in a stable state" );
+			end_of_statement();
+		} else if( is( cmd, "ENDIR" ) ) {
+			end_ir = state( word(), true );
+			end_of_statement();
+		} else if( is( cmd, "ENDDR" ) ) {
+			end_dr = state( word(), true );
+			end_of_statement();
+		} else if( is( cmd, "TRST" ) ) {
+			let t = word();
+			if( is( t, "ON" ) )
+				player.jtag.trst( true );
+			else if( is( t, "OFF" ) || is( t, "Z" ) || is( t, "ABSENT" ) )
+				player.jtag.trst( false );
+			else
+				error( "invalid TRST mode" );
+			end_of_statement();
+		} else if( is( cmd, "FREQUENCY" ) ) {
+			// the pins go as fast as they go
+			while( word().n )
+				;
+			end_of_statement();
+		} else {
+			error( "unsupported command \"%.*s\"", cmd.n, cmd.s );
+		}
+	}
+
+	let play() -> void
+	{
+		player.line = 1;
+		for( ;; ) {
+			skip();
+			if( p == end )
+				break;
+			statement();
+		}
+	}
+};
+
+
+//-------------- XSVF --------------------------------------------------------//
+
+namespace xsvf {
+enum : u8 {
+	complete	= 0,
+	tdomask		= 1,
+	sir		= 2,
+	sdr		= 3,
+	runtest		= 4,
+	repeat		= 7,
+	sdrsize		= 8,
+	sdrtdo		= 9,
+	setsdrmasks	= 10,
+	sdrinc		= 11,
+	sdrb		= 12,
+	sdrc		= 13,
+	sdre		= 14,
+	sdrtdob		= 15,
+	sdrtdoc		= 16,
+	sdrtdoe		= 17,
+	state		= 18,
+	endir		= 19,
+	enddr		= 20,
+	sir2		= 21,
+	comment		= 22,
+	wait		= 23,
+};
+} // namespace xsvf
+
+struct Xsvf {
+	Player &player;
+	char const *p;
+	char const *const end;
+	char const *const begin;
+
+	Xsvf( Player &player, char const *data, size_t size )
+		: player( player ), p( data ), end( data + size ), begin( data ) {}
+
+	TapState end_ir = TapState::idle;
+	TapState end_dr = TapState::idle;
+	uint runtest = 0;	// microseconds (and at least as many TCK cycles)
+	uint repeat = 32;	// retries of a DR scan whose TDO mismatches
+
+	Part ir, dr;
+
+	[[ noreturn ]]
+	let error( char const *msg, uint x = 0 ) -> void
+	{
+		fprintf( stderr, "%s: offset %u: ", player.path, player.line );
+		die( msg, x );
+	}
+
+	let bytes( size_t n ) -> char const *
+	{
+		if( (size_t)( end - p ) < n )
+			error( "truncated\n" );
+		let s = p;
+		p += n;
+		return s;
+	}
+	let byte() -> uint {  return (u8) *bytes( 1 );  }
+	let u16_be() -> uint {  return byte() << 8 | byte();  }
+	let u32_be() -> uint {  return u16_be() << 16 | u16_be();  }
+
+	let vector( uint nbits ) -> Vec
+	{
+		let n = ( nbits + 7 ) / 8;
+		return Vec { bytes( n ), n, false, 0 };
+	}
+
+	let state( uint s ) -> TapState
+	{
+		if( s >= tap_nstates )
+			error( "invalid state %u\n", s );
+		return (TapState) s;
+	}
+
+	// in microseconds, so at most 1 MHz TCK
+	let wait( TapState s, uint usecs ) -> void
+	{
+		player.wait( s, usecs, usecs * 1e-6 );
+	}
+
+	let scan_ir( uint nbits ) -> void
+	{
+		ir.resize( nbits );
+		ir.tdi = vector( nbits );
+		Part const *parts[] = { &ir };
+		player.scan( TapState::ir_shift, parts, end_ir );
+		if( runtest && end_ir == TapState::idle )
+			wait( TapState::idle, runtest );
+	}
+
+	// a DR scan, retried after waiting a bit longer each time as long as TDO
+	// mismatches and retries are left
+	let scan_dr() -> void
+	{
+		Part const *parts[] = { &dr };
+		let wait_time = runtest;
+		for( uint retry = 0;; ++retry ) {
+			let last = retry == repeat;
+			if( player.scan( TapState::dr_shift, parts, end_dr, last ) )
+				break;
+			if( last )
+				exit( EXIT_FAILURE );
+			wait_time += wait_time / 4;
+			wait( TapState::idle, wait_time );
+		}
+		if( runtest && end_dr == TapState::idle )
+			wait( TapState::idle, runtest );
+	}
+
+	let play() -> void
+	{
+		player.offsets = true;
+		for( ;; ) {
+			player.line = (uint)( p - begin );
+			let cmd = byte();
+			switch( cmd ) {
+			case xsvf::complete:
+				return;
+			case xsvf::tdomask:
+				dr.mask = vector( dr.nbits );
+				break;
+			case xsvf::sir:
+				scan_ir( byte() );
+				break;
+			case xsvf::sir2:
+				scan_ir( u16_be() );
+				break;
+			case xsvf::sdr:
+				dr.tdi = vector( dr.nbits );
+				scan_dr();
+				break;
+			case xsvf::sdrtdo:
+				dr.tdi = vector( dr.nbits );
+				dr.tdo = vector( dr.nbits );
+				dr.check = true;
+				scan_dr();
+				break;
+			case xsvf::runtest:
+				runtest = u32_be();
+				break;
+			case xsvf::repeat:
+				repeat = byte();
+				break;
+			case xsvf::sdrsize:
+				dr.resize( u32_be() );
+				break;
+			case xsvf::state:
+				player.tap_goto( state( byte() ) );
+				break;
+			case xsvf::endir:
+				end_ir = byte() ? TapState::ir_pause : TapState::idle;
+				break;
+			case xsvf::enddr:
+				end_dr = byte() ? TapState::dr_pause : TapState::idle;
+				break;
+			case xsvf::comment:
+				while( *bytes( 1 ) )
+					;
+				break;
+			case xsvf::wait: {
+				let s = state( byte() );
+				let e = state( byte() );
+				wait( s, u32_be() );
+				player.tap_goto( e );
+				break;
+			}
+			default:
+				error( "unsupported XSVF command %u\n", cmd );
+			}
+		}
+	}
+};
+
+
+//-------------- main --------------------------------------------------------//
+
+let static player = Player {};
+
+let main( int argc, char **argv ) -> int
+{
+	if( argc != 2 )
+		die( "usage: %s FILE.svf|FILE.xsvf\n", argv[ 0 ] );
+	let path = argv[ 1 ];
+
+	let fd = open( path, O_RDONLY | O_CLOEXEC );
+	if( fd < 0 )
+		die( "%s: %m\n", path );
+	struct stat st;
+	if( fstat( fd, &st ) < 0 )
+		die( "%s: %m\n", path );
+	let size = (size_t) st.st_size;
+	let data = (char const *) "";
+	if( size ) {
+		let map = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if( map == MAP_FAILED )
+			die( "%s: mmap: %m\n", path );
+		madvise( map, size, MADV_SEQUENTIAL );
+		data = (char const *) map;
+	}
+	close( fd );
+
+	let ext = strrchr( path, '.' );
+	let binary = ext && ! strcasecmp( ext, ".xsvf" );
+
+	player.path = path;
+	player.init();
+
+	let t0 = now();
+	if( binary )
+		Xsvf { player, data, size }.play();
+	else
+		Svf { player, data, size }.play();
+	player.jtag.flush();
+	let secs = now() - t0;
+
+	printf( "%s: ok, %u scans (%u checked), %llu TCK cycles, %.3f s\n",
+			path, player.nscans, player.nchecks,
+			(unsigned long long) player.hw.stats.tck_cycles, secs );
+	return 0;
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include "defs.h"
+
+//-------------- IEEE 1149.1 TAP controller ----------------------------------//
+
+enum class TapState : u8 {
+	reset,
+	idle,
+
+	dr_select,
+	dr_capture,
+	dr_shift,
+	dr_exit1,
+	dr_pause,
+	dr_exit2,
+	dr_update,
+
+	ir_select,
+	ir_capture,
+	ir_shift,
+	ir_exit1,
+	ir_pause,
+	ir_exit2,
+	ir_update,
+};
+
+let constexpr tap_nstates = 16u;
+
+// state reached from given state by one TCK cycle with given TMS level
+let constexpr tap_next( TapState s, bool tms ) -> TapState
+{
+	using S = TapState;
+	switch( s ) {
+	case S::reset:		return tms ? S::reset      : S::idle;
+	case S::idle:		return tms ? S::dr_select  : S::idle;
+
+	case S::dr_select:	return tms ? S::ir_select  : S::dr_capture;
+	case S::dr_capture:	return tms ? S::dr_exit1   : S::dr_shift;
+	case S::dr_shift:	return tms ? S::dr_exit1   : S::dr_shift;
+	case S::dr_exit1:	return tms ? S::dr_update  : S::dr_pause;
+	case S::dr_pause:	return tms ? S::dr_exit2   : S::dr_pause;
+	case S::dr_exit2:	return tms ? S::dr_update  : S::dr_shift;
+	case S::dr_update:	return tms ? S::dr_select  : S::idle;
+
+	case S::ir_select:	return tms ? S::reset      : S::ir_capture;
+	case S::ir_capture:	return tms ? S::ir_exit1   : S::ir_shift;
+	case S::ir_shift:	return tms ? S::ir_exit1   : S::ir_shift;
+	case S::ir_exit1:	return tms ? S::ir_update  : S::ir_pause;
+	case S::ir_pause:	return tms ? S::ir_exit2   : S::ir_pause;
+	case S::ir_exit2:	return tms ? S::ir_update  : S::ir_shift;
+	case S::ir_update:	return tms ? S::dr_select  : S::idle;
+	}
+	return S::reset;
+}
+
+// stable states are those in which the TAP can be kept by clocking TCK with
+// constant TMS without any side-effects
+let constexpr tap_stable( TapState s ) -> bool
+{
+	return s == TapState::reset || s == TapState::idle ||
+		s == TapState::dr_shift || s == TapState::dr_pause ||
+		s == TapState::ir_shift || s == TapState::ir_pause;
+}
+
+let constexpr tap_name( TapState s ) -> char const *
+{
+	constexpr char const *names[] = {
+		"reset", "idle",
+		"dr-select", "dr-capture", "dr-shift", "dr-exit1",
+		"dr-pause", "dr-exit2", "dr-update",
+		"ir-select", "ir-capture", "ir-shift", "ir-exit1",
+		"ir-pause", "ir-exit2", "ir-update",
+	};
+	return names[ (uint) s ];
+}
+
+
+//-------------- Shortest TMS paths ------------------------------------------//
+//
+// TMS sequence (lsb first) that takes the TAP from one state to another in the
+// least number of TCK cycles.  The path from a state to itself is empty.
+//
+// No path is longer than 8 cycles (e.g. Shift-DR -> Exit2-IR), so the sequence
+// fits in a byte.
+
+struct TmsPath {
+	u8 len;
+	u8 tms;
+};
+
+struct TmsPathTable {
+	TmsPath path[ tap_nstates ][ tap_nstates ];
+
+	let constexpr operator () ( TapState from, TapState to ) const -> TmsPath {
+		return path[ (uint) from ][ (uint) to ];
+	}
+};
+
+// breadth-first search from every state
+let constexpr tap_make_paths() -> TmsPathTable
+{
+	TmsPathTable table {};
+
+	forseq( from, 0u, tap_nstates ) {
+		let &paths = table.path[ from ];
+		bool seen[ tap_nstates ] = {};
+		uint queue[ tap_nstates ] = {};
+		uint head = 0, tail = 0;
+
+		seen[ from ] = true;
+		queue[ tail++ ] = from;
+
+		while( head != tail ) {
+			let s = queue[ head++ ];
+			forseq( tms, 0u, 2u ) {
+				let t = (uint) tap_next( (TapState) s, tms );
+				if( seen[ t ] )
+					continue;
+				seen[ t ] = true;
+				queue[ tail++ ] = t;
+				paths[ t ].len = paths[ s ].len + 1;
+				paths[ t ].tms = paths[ s ].tms | tms << paths[ s ].len;
+			}
+		}
+	}
+
+	return table;
+}
+
+let constexpr tap_paths = tap_make_paths();
+
+static_assert( tap_paths( TapState::dr_update, TapState::dr_shift ).len == 3, "" );
+static_assert( tap_paths( TapState::dr_update, TapState::dr_shift ).tms == 0b001, "" );
+static_assert( tap_paths( TapState::idle, TapState::ir_shift ).len == 4, "" );
+static_assert( tap_paths( TapState::idle, TapState::ir_shift ).tms == 0b0011, "" );
+static_assert( tap_paths( TapState::ir_shift, TapState::idle ).tms == 0b011, "" );
@@ -0,0 +1,26 @@
+#pragma once
+#include "defs.h"
+#include "chain.h"
+
+
+//-------------- Debug hw config ---------------------------------------------//
+
+constexpr u32 idcode_mask  = 0x0'ffff'fff;
+constexpr u32 idcode_match = 0x0'b944'02f;
+
+// the scan chain, nearest TDO first.  the DAP is linked in by the icepick,
+// through whichever secondary TAP it turns out to be on (the one given is only
+// used when that can't be found out, i.e. without TDO).
+constexpr TapDesc chain_taps[] = {
+	//  name	ir_len	bypass		reset (idcode)	idcode		icepick reg
+	{ "dap",	4,	0b1111,		0b1110,		0x3ba00477,	0x2c },
+	{ "icepick",	6,	0b111111,	0b000100,	idcode_match,	0 },
+};
+
+// initialization of icepick registers, besides linking in the TAPs
+constexpr u32 icepick_init_regs[] = {
+	0x60'002000,  // assert cortex-a8 DBGEN
+};
+
+// address of cortex-a8 debug regs on debug APB
+constexpr u32 a8_debug = 0x800'01'000;
@@ -0,0 +1,42 @@
+#include "defs.h"
+#include "die.h"
+#include "translog.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+//-------------- Transaction log ---------------------------------------------//
+
+let TransLog::open( char const *path ) -> void
+{
+	file = fopen( path, "wb" );
+	if( ! file )
+		die( "%s: %m\n", path );
+	if( fwrite( translog_magic, strlen( translog_magic ), 1, file ) != 1 )
+		die( "%s: %m\n", path );
+}
+
+let TransLog::write( TransRecord const &rec ) -> void
+{
+	if( fwrite( &rec, sizeof rec, 1, file ) != 1 )
+		die( "transaction log write: %m\n" );
+}
+
+let TransLog::finish( HwStats const &stats ) -> void
+{
+	write( TransRecord { TransKind::end, 0, 0, 0, 0, 0 } );
+	if( fwrite( &stats, sizeof stats, 1, file ) != 1 || fclose( file ) )
+		die( "transaction log write: %m\n" );
+	file = NULL;
+}
+
+let static env_translog = TransLog {};
+
+let translog_env() -> TransLog *
+{
+	let path = getenv( "JBANG_TRANSLOG" );
+	if( ! path || ! *path )
+		return NULL;
+	env_translog.open( path );
+	return &env_translog;
+}
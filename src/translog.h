@@ -0,0 +1,114 @@
+#pragma once
+#include "defs.h"
+#include "die.h"
+#include "jtag.h"
+#include "hw-stats.h"
+#include <stdio.h>
+
+
+//-------------- Transaction log ---------------------------------------------//
+//
+// Records a session at the level of transactions rather than pins:  every DAP
+// op (see Dap::scan_op) and ICEPick router access along with the response it
+// got, plus the TAP resets, links and idle cycles that shape the chain around
+// them.  The replay program feeds such a log back through the chain and the
+// JTAG engine against a target that answers with the recorded responses, so a
+// session captured on the board becomes a deterministic benchmark and check of
+// everything from the chain down to the pins, runnable on any machine.
+//
+// A chain records to the log it's given (Chain::translog).  Responses only
+// come in once the scan queue gets flushed, so records wait in a FIFO until
+// their captures have resolved, rather than forcing flushes of their own.
+//
+// File format:  the magic below, then TransRecords in host byte order, ending
+// with an end record followed by the HwStats of the recording backend.
+
+let constexpr translog_magic = "jbtlog1\n";
+
+enum class TransKind : u8 {
+	reset,		// TAP reset, response = IDCODE of the chain read after it
+	link,		// tap linked into the chain
+	idle,		// arg = Run-Test/Idle cycles
+	dap_op,		// scan of tap with instruction ir, op | arg << 3 shifted in,
+			// response = ack | data << 3 shifted out
+	router,		// ICEPick router access through tap (with instruction ir),
+			// arg = word shifted in, if op is set followed by a readback
+			// scan whose result is the response
+	end,
+};
+
+struct TransRecord {
+	TransKind kind;
+	u8 tap;
+	u8 ir;
+	u8 op;
+	u32 arg;
+	u64 response;
+};
+
+static_assert( sizeof( TransRecord ) == 16, "" );
+
+let constexpr translog_pending_size = 1024u;
+
+struct TransLog {
+	FILE *file = NULL;
+
+	// records waiting for their response
+	struct Pending {
+		TransRecord rec;
+		Scan scan;
+		bool wait;
+	};
+	array< Pending, translog_pending_size > pending {};
+	uint head = 0;
+	uint tail = 0;
+
+	// start logging to a file
+	let open( char const *path ) -> void;
+
+	let write( TransRecord const &rec ) -> void;
+
+	// write out the records whose responses are in
+	template< typename Hw >
+	let drain( Jtag<Hw> &jtag ) -> void
+	{
+		for( ; tail != head; ++tail ) {
+			let &p = pending[ tail % translog_pending_size ];
+			if( p.wait ) {
+				if( ! jtag.resolved( p.scan ) )
+					return;
+				p.rec.response = jtag.get( p.scan );
+			}
+			write( p.rec );
+		}
+	}
+
+	// log a transaction, with the response resolved from scan if given
+	template< typename Hw >
+	let record( Jtag<Hw> &jtag, TransRecord const &rec, Scan const *scan = NULL ) -> void
+	{
+		drain( jtag );
+		if( head - tail == translog_pending_size ) {
+			// can't happen with the scan queue being smaller
+			jtag.scan_flush();
+			drain( jtag );
+		}
+		pending[ head++ % translog_pending_size ] =
+			Pending { rec, scan ? *scan : Scan {}, scan != NULL };
+	}
+
+	// perform what's queued and write out everything
+	template< typename Hw >
+	let close( Jtag<Hw> &jtag ) -> void
+	{
+		jtag.flush();
+		drain( jtag );
+		finish( jtag.hw.stats );
+	}
+
+	let finish( HwStats const &stats ) -> void;
+};
+
+// if $JBANG_TRANSLOG is set, a log to the file it names (NULL otherwise).  it
+// needs to be closed by the program, since only that can flush the scans.
+let translog_env() -> TransLog *;
@@ -0,0 +1,146 @@
+#pragma once
+#include "defs.h"
+#include "die.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+//-------------- io_uring ----------------------------------------------------//
+//
+// Bare-bones io_uring, using the raw syscalls, for submitting a bunch of
+// requests and waiting until they've all completed.  Nothing more is needed
+// here, so no point in depending on liburing.
+//
+// In SQPOLL mode a kernel thread picks up submissions, so as long as it's
+// awake neither submitting nor waiting (which spins on the completion ring)
+// takes a syscall.  Spinning is bounded though:  if the completions take too
+// long, e.g. because the thread went to sleep after all, it waits for them in
+// io_uring_enter() instead.
+
+let constexpr uring_spin_limit = 1u << 16;	// polls of the completion ring
+
+struct Uring {
+	int fd = -1;
+	bool sqpoll = false;
+
+	u32 *sq_head, *sq_tail, *sq_mask, *sq_flags, *sq_array;
+	io_uring_sqe *sqes;
+	u32 *cq_head, *cq_tail, *cq_mask;
+	io_uring_cqe *cqes;
+
+	uint queued = 0;	// prepared but not yet submitted
+
+	let ok() const -> bool {  return fd >= 0;  }
+
+	// returns false if io_uring is unavailable (or SQPOLL not permitted)
+	let setup( uint entries, bool poll ) -> bool
+	{
+		let p = io_uring_params {};
+		if( poll ) {
+			p.flags = IORING_SETUP_SQPOLL;
+			p.sq_thread_idle = 1000;  // ms
+		}
+		let res = (int) syscall( __NR_io_uring_setup, entries, &p );
+		if( res < 0 )
+			return false;
+
+		let sq_size = p.sq_off.array + p.sq_entries * sizeof(u32);
+		let cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		if( p.features & IORING_FEAT_SINGLE_MMAP )
+			sq_size = cq_size = max( sq_size, cq_size );
+
+		let map = [res]( size_t size, off_t off ) -> char * {
+			let ptr = mmap( NULL, size, PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_POPULATE, res, off );
+			if( ptr == MAP_FAILED )
+				die( "io_uring mmap: %m\n" );
+			return (char *) ptr;
+		};
+
+		let sq = map( sq_size, IORING_OFF_SQ_RING );
+		let cq = p.features & IORING_FEAT_SINGLE_MMAP ? sq :
+				map( cq_size, IORING_OFF_CQ_RING );
+		sqes = (io_uring_sqe *) map( p.sq_entries * sizeof(io_uring_sqe),
+				IORING_OFF_SQES );
+
+		sq_head  = (u32 *)( sq + p.sq_off.head );
+		sq_tail  = (u32 *)( sq + p.sq_off.tail );
+		sq_mask  = (u32 *)( sq + p.sq_off.ring_mask );
+		sq_flags = (u32 *)( sq + p.sq_off.flags );
+		sq_array = (u32 *)( sq + p.sq_off.array );
+		cq_head  = (u32 *)( cq + p.cq_off.head );
+		cq_tail  = (u32 *)( cq + p.cq_off.tail );
+		cq_mask  = (u32 *)( cq + p.cq_off.ring_mask );
+		cqes = (io_uring_cqe *)( cq + p.cq_off.cqes );
+
+		fd = res;
+		sqpoll = poll;
+		return true;
+	}
+
+	// next submission entry, cleared.  at most as many as the ring has
+	// entries can be prepared before submit().
+	let prepare() -> io_uring_sqe &
+	{
+		let tail = *sq_tail + queued++;
+		let index = tail & *sq_mask;
+		sq_array[ index ] = index;
+		let &sqe = sqes[ index ];
+		sqe = io_uring_sqe {};
+		return sqe;
+	}
+
+	// submit everything prepared and wait for its completion, calling
+	// check( cqe ) for each.  returns the number of syscalls it took.
+	template< typename Check >
+	let submit( Check &&check ) -> uint
+	{
+		let n = queued;
+		let syscalls = 0u;
+		queued = 0;
+		__atomic_store_n( sq_tail, *sq_tail + n, __ATOMIC_RELEASE );
+
+		if( sqpoll ) {
+			// the tail store must be visible before the flag is
+			// checked, or the thread could go to sleep without us
+			// seeing it needs a wakeup (io_uring_smp_mb in liburing)
+			__atomic_thread_fence( __ATOMIC_SEQ_CST );
+			let flags = __atomic_load_n( sq_flags, __ATOMIC_ACQUIRE );
+			if( flags & IORING_SQ_NEED_WAKEUP ) {
+				enter( 0, 0, IORING_ENTER_SQ_WAKEUP );
+				++syscalls;
+			}
+		} else {
+			enter( n, n, IORING_ENTER_GETEVENTS );
+			++syscalls;
+		}
+
+		let spins = 0u;
+		for( uint done = 0; done < n; ) {
+			let head = *cq_head;
+			if( head == __atomic_load_n( cq_tail, __ATOMIC_ACQUIRE ) ) {
+				// only happens with sqpoll
+				if( ++spins == uring_spin_limit ) {
+					enter( 0, n - done, IORING_ENTER_GETEVENTS |
+							IORING_ENTER_SQ_WAKEUP );
+					++syscalls;
+					spins = 0;
+				}
+				continue;
+			}
+			check( cqes[ head & *cq_mask ] );
+			__atomic_store_n( cq_head, head + 1, __ATOMIC_RELEASE );
+			++done;
+		}
+		return syscalls;
+	}
+
+	let enter( uint to_submit, uint min_complete, uint flags ) -> void
+	{
+		if( syscall( __NR_io_uring_enter, fd, to_submit, min_complete,
+					flags, NULL, 0 ) < 0 )
+			die( "io_uring_enter: %m\n" );
+	}
+};
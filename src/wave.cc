@@ -0,0 +1,104 @@
+#include "defs.h"
+#include "die.h"
+#include "wave.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+//-------------- Waveform recording ------------------------------------------//
+
+let static now_ns() -> u64
+{
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (u64) ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+}
+
+let static write_all( int fd, u8 const *data, size_t n ) -> void
+{
+	while( n ) {
+		let res = write( fd, data, n );
+		if( res < 0 )
+			die( "waveform write: %m\n" );
+		data += res;
+		n -= res;
+	}
+}
+
+let WaveRecorder::open( char const *path ) -> void
+{
+	fd = ::open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 );
+	if( fd < 0 )
+		die( "%s: %m\n", path );
+	write_all( fd, (u8 const *) wave_magic, strlen( wave_magic ) );
+
+	ring = (u8 *) malloc( ring_size );
+	if( ! ring )
+		die( "out of memory\n" );
+	last_ns = now_ns();
+
+	let err = pthread_create( &writer, NULL, writer_main, this );
+	if( err )
+		die( "pthread_create: %s\n", strerror( err ) );
+}
+
+let WaveRecorder::close() -> void
+{
+	if( fd < 0 )
+		return;
+	time();
+	__atomic_store_n( &stop, true, __ATOMIC_RELEASE );
+	pthread_join( writer, NULL );
+	::close( fd );
+	fd = -1;
+	free( ring );
+	ring = NULL;
+}
+
+let WaveRecorder::time() -> void
+{
+	let t = now_ns();
+	let delta = t - last_ns;
+	last_ns = t;
+	for( ; delta >= wave::time_more; delta >>= 5 )
+		put( (u8)( wave::time_delta | wave::time_more | ( delta & 0x1f ) ) );
+	put( (u8)( wave::time_delta | delta ) );
+}
+
+// write out what's in the ring every millisecond, until stopped and it's
+// empty.  in between it leaves the ring alone, so the recording thread has
+// its cache lines to itself.
+let WaveRecorder::writer_main( void *arg ) -> void *
+{
+	let &rec = *(WaveRecorder *) arg;
+	for( ;; ) {
+		let stopping = __atomic_load_n( &rec.stop, __ATOMIC_ACQUIRE );
+		let h = __atomic_load_n( &rec.head, __ATOMIC_ACQUIRE );
+		for( let t = rec.tail; t != h; ) {
+			// up to the end of the ring, then from its start
+			let start = t % ring_size;
+			let n = min( h - t, (u64)( ring_size - start ) );
+			write_all( rec.fd, rec.ring + start, n );
+			t += n;
+			__atomic_store_n( &rec.tail, t, __ATOMIC_RELEASE );
+		}
+		if( stopping )
+			return NULL;
+		usleep( 1000 );
+	}
+}
+
+let static env_recorder = WaveRecorder {};
+
+let wave_record_env() -> WaveRecorder *
+{
+	let path = getenv( "JBANG_RECORD" );
+	if( ! path || ! *path )
+		return NULL;
+	env_recorder.open( path );
+	atexit( []() {  env_recorder.close();  } );
+	return &env_recorder;
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include "defs.h"
+#include <pthread.h>
+
+
+//-------------- Waveform recording ------------------------------------------//
+//
+// Records what a JTAG backend does with the pins, for finding out afterwards
+// where the time goes in a long session (see wave2vcd for viewing it).
+//
+// Every pin write and TDO sample is a 1-byte event, stored in a ring buffer
+// and written out to the file by a thread of its own, so recording costs the
+// hot path a byte store and nothing is formatted until later.  Time is taken
+// only where the backend blocked, i.e. where sampling TDO or a flush took
+// syscalls (reading the clock may itself take one on the target), and the
+// time since the previous such point is recorded as a delta before the event.
+//
+// If the writer thread can't keep up the events that don't fit are dropped,
+// which is marked in the recording, rather than slowing down the session.
+//
+// File format:  the magic below, then the events.
+
+let constexpr wave_magic = "jbwave1\n";
+
+namespace wave {
+
+enum Pin : u8 {
+	trst,
+	tck,
+	tms,
+	tdi,
+};
+
+enum : u8 {
+	// 00pp000l	write of level l to pin p
+	pin_write	= 0x00,
+	// 0100000l	TDO sampled at level l
+	tdo_sample	= 0x40,
+	// 10cddddd	time delta in ns, 5 bits at a time, least significant first,
+	//		c set in all but the last byte
+	time_delta	= 0x80,
+	time_more	= 0x20,
+	// 11111111	events were lost here
+	lost		= 0xff,
+};
+
+let constexpr pin_event( Pin pin, bool level ) -> u8
+{
+	return (u8)( pin_write | pin << 4 | level );
+}
+
+} // namespace wave
+
+struct WaveRecorder {
+	let static constexpr ring_size = 1u << 20;	// bytes, power of two
+
+	// written by the recording thread
+	u8 *ring = NULL;
+	u64 head = 0;
+	u64 tail_seen = 0;	// tail as last loaded
+	bool lost = false;	// events dropped since the last one stored
+
+	// written by the writer thread, on a cache line of its own
+	alignas( 64 ) u64 tail = 0;
+
+	alignas( 64 ) int fd = -1;
+	bool stop = false;
+	pthread_t writer;
+
+	u64 last_ns = 0;
+
+	// start recording to a file
+	let open( char const *path ) -> void;
+
+	// stop recording, writing out everything recorded
+	let close() -> void;
+
+	let put( u8 event ) -> void
+	{
+		// room for the event and a lost marker
+		if( head - tail_seen > ring_size - 2 ) {
+			tail_seen = __atomic_load_n( &tail, __ATOMIC_ACQUIRE );
+			if( head - tail_seen > ring_size - 2 ) {
+				lost = true;
+				return;
+			}
+		}
+		let h = head;
+		if( lost ) {
+			ring[ h++ % ring_size ] = wave::lost;
+			lost = false;
+		}
+		ring[ h++ % ring_size ] = event;
+		__atomic_store_n( &head, h, __ATOMIC_RELEASE );
+	}
+
+	// record the time since the last call
+	let time() -> void;
+
+	let static writer_main( void *arg ) -> void *;
+};
+
+// if $JBANG_RECORD is set, a recorder writing to the file it names, which gets
+// closed when the program exits (NULL otherwise)
+let wave_record_env() -> WaveRecorder *;
+
+// a JTAG backend (see jtag.h) that records what it does if given a recorder
+template< typename Hw >
+struct Recorded : Hw {
+	WaveRecorder *recorder = NULL;
+
+	let record( wave::Pin pin, bool level ) -> void {
+		if( recorder )
+			recorder->put( wave::pin_event( pin, level ) );
+	}
+
+	let trst( bool level ) -> void {  Hw::trst( level );  record( wave::trst, level );  }
+	let tck( bool level ) -> void {  Hw::tck( level );  record( wave::tck, level );  }
+	let tms( bool level ) -> void {  Hw::tms( level );  record( wave::tms, level );  }
+	let tdi( bool level ) -> void {  Hw::tdi( level );  record( wave::tdi, level );  }
+
+	// time is taken only if the backend actually had to block
+	u64 syscalls_seen = 0;
+
+	let blocked() -> void {
+		if( Hw::stats.syscalls == syscalls_seen )
+			return;
+		syscalls_seen = Hw::stats.syscalls;
+		recorder->time();
+	}
+
+	let tdo() -> bool {
+		let level = Hw::tdo();
+		if( recorder ) {
+			blocked();
+			recorder->put( (u8)( wave::tdo_sample | level ) );
+		}
+		return level;
+	}
+
+	let flush() -> void {
+		Hw::flush();
+		if( recorder )
+			blocked();
+	}
+};
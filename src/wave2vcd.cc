@@ -0,0 +1,126 @@
+#include "defs.h"
+#include "die.h"
+#include "wave.h"
+#include <stdio.h>
+#include <string.h>
+
+// Converts a waveform recorded by a JTAG program (see wave.h) to VCD, for
+// viewing in e.g. GTKWave:
+//
+//	wave2vcd IN.wave > OUT.vcd
+//
+// Time is only recorded at the points where the backend blocked (TDO samples
+// and flushes that took syscalls), so the pin events in between are placed
+// 1 ns apart, following the earlier point.  Besides the pins there are two
+// marker signals, high for an instant where TDO was sampled and where events
+// got lost respectively.
+
+enum : uint {
+	sig_trst,
+	sig_tck,
+	sig_tms,
+	sig_tdi,
+	sig_tdo,
+	sig_sample,
+	sig_lost,
+	nsigs
+};
+
+constexpr char const *sig_names[ nsigs ] = {
+	"trst", "tck", "tms", "tdi", "tdo", "sample", "lost",
+};
+
+struct Vcd {
+	FILE *out;
+	u64 now = 0;		// of the last event written
+	u64 real = 0;		// as recorded
+	bool started = false;
+	int level[ nsigs ];
+
+	explicit Vcd( FILE *out ) : out( out ) {}
+
+	let header() -> void
+	{
+		fprintf( out, "$timescale 1ns $end\n$scope module jtag $end\n" );
+		forseq( s, 0u, nsigs )
+			fprintf( out, "$var wire 1 %c %s $end\n", '!' + s, sig_names[ s ] );
+		fprintf( out, "$upscope $end\n$enddefinitions $end\n" );
+		forseq( s, 0u, nsigs )
+			level[ s ] = -1;
+	}
+
+	// move on to the time of the next event
+	let step() -> void
+	{
+		let t = max( started ? now + 1 : 0, real );
+		started = true;
+		now = t;
+		fprintf( out, "#%llu\n", (unsigned long long) t );
+
+		// markers only last for an instant
+		set( sig_sample, 0 );
+		set( sig_lost, 0 );
+	}
+
+	let set( uint sig, bool x ) -> void
+	{
+		if( level[ sig ] == x )
+			return;
+		level[ sig ] = x;
+		fprintf( out, "%u%c\n", x, '!' + sig );
+	}
+};
+
+let main( int argc, char **argv ) -> int
+{
+	if( argc != 2 )
+		die( "usage: %s IN.wave > OUT.vcd\n", argv[ 0 ] );
+
+	let in = fopen( argv[ 1 ], "rb" );
+	if( ! in )
+		die( "%s: %m\n", argv[ 1 ] );
+	let magic_len = strlen( wave_magic );
+	char magic[ 16 ];
+	if( fread( magic, 1, magic_len, in ) != magic_len || memcmp( magic, wave_magic, magic_len ) )
+		die( "%s: not a recorded waveform\n", argv[ 1 ] );
+
+	let vcd = Vcd { stdout };
+	vcd.header();
+
+	u64 delta = 0;
+	uint delta_shift = 0;
+	u8 buf[ 65536 ];
+	for( size_t n; ( n = fread( buf, 1, sizeof buf, in ) ); ) {
+		forseq( i, (size_t) 0, n ) {
+			let ev = buf[ i ];
+			if( ( ev & 0xc0 ) == wave::time_delta ) {
+				delta |= (u64)( ev & 0x1f ) << delta_shift;
+				delta_shift += 5;
+				if( ! ( ev & wave::time_more ) ) {
+					vcd.real += delta;
+					delta = 0;
+					delta_shift = 0;
+				}
+				continue;
+			}
+
+			vcd.step();
+			if( ev == wave::lost ) {
+				vcd.set( sig_lost, 1 );
+			} else if( ( ev & 0xc0 ) == wave::tdo_sample ) {
+				vcd.set( sig_tdo, ev & 1 );
+				vcd.set( sig_sample, 1 );
+			} else {
+				vcd.set( ev >> 4 & 3, ev & 1 );
+			}
+		}
+	}
+	if( ferror( in ) )
+		die( "%s: %m\n", argv[ 1 ] );
+	fclose( in );
+
+	// the time after the last event
+	if( vcd.real > vcd.now )
+		vcd.step();
+	return 0;
+}